@@ -0,0 +1,40 @@
+/// Data structures defining the format of memory reference traces.
+///
+/// A trace is a header followed by one record per memory reference made by
+/// user programs, in the order they were made.  Fields are in the byte
+/// order of the host that wrote the trace.
+///
+/// Copyright (c) 2016-2020 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+#ifndef NACHOS_BIN_MEMTRACE__H
+#define NACHOS_BIN_MEMTRACE__H
+
+
+#include <stdint.h>
+
+
+#define MEM_TRACE_MAGIC    0x4E545243  // Denotes a memory reference trace.
+#define MEM_TRACE_VERSION  1
+
+#define MEM_TRACE_WRITE  0x1  // Flag of references that write memory.
+
+typedef struct memTraceHeader {
+    uint32_t magic;       // Should be `MEM_TRACE_MAGIC`.
+    uint32_t version;     // Should be `MEM_TRACE_VERSION`.
+    uint32_t recordSize;  // Should be `sizeof (memTraceRecord)`.
+    uint32_t pageSize;    // Page size of the machine traced.
+} memTraceHeader;
+
+typedef struct memTraceRecord {
+    uint32_t pc;            // Address of the instruction referencing.
+    uint32_t virtualAddr;   // Address referenced.
+    uint32_t physicalAddr;  // Address it translated to.
+    uint16_t space;         // Address space, never reused within a trace.
+    uint8_t size;           // Bytes referenced: 1, 2, or 4.
+    uint8_t flags;          // Combination of `MEM_TRACE_*` flags.
+} memTraceRecord;
+
+
+#endif
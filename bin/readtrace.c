@@ -0,0 +1,75 @@
+/// Program that prints memory reference traces written by `nachos -trace`.
+///
+/// With `-s`, only prints how many references of each kind there are.
+///
+/// Copyright (c) 2016-2020 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+
+#include "mem_trace.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+#define BUFFER_SIZE  4096  // Records read at a time.
+
+int
+main(int argc, char *argv[])
+{
+    int summary = argc > 2 && strcmp(argv[1], "-s") == 0;
+    if (argc != 2 + summary) {
+        fprintf(stderr, "Usage: %s [-s] <path to trace file>\n", argv[0]);
+        return 1;
+    }
+
+    // Open the trace file.
+    const char *path = argv[1 + summary];
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return 1;
+    }
+
+    // Read the file's header.
+    memTraceHeader h;
+    if (fread(&h, sizeof h, 1, f) != 1) {
+        fprintf(stderr, "%s: not a memory trace\n", path);
+        fclose(f);
+        return 1;
+    }
+    if (h.magic != MEM_TRACE_MAGIC || h.version != MEM_TRACE_VERSION
+          || h.recordSize != sizeof (memTraceRecord)) {
+        fprintf(stderr, "%s: not a memory trace of this version\n", path);
+        fclose(f);
+        return 1;
+    }
+
+    // Print or count the records, a buffer at a time.
+    static memTraceRecord records[BUFFER_SIZE];
+    unsigned long long reads = 0, writes = 0, bytes = 0;
+    size_t n;
+    if (!summary)
+        printf("PC         Virtual    Physical   Size Kind  Space\n");
+    while ((n = fread(records, sizeof *records, BUFFER_SIZE, f)) > 0)
+        for (size_t i = 0; i < n; i++) {
+            const memTraceRecord *r = &records[i];
+            int writing = r->flags & MEM_TRACE_WRITE;
+            if (writing)
+                writes++;
+            else
+                reads++;
+            bytes += r->size;
+            if (!summary)
+                printf("0x%08X 0x%08X 0x%08X %4u %-5s %5u\n",
+                       r->pc, r->virtualAddr, r->physicalAddr, r->size,
+                       writing ? "write" : "read", r->space);
+        }
+    fclose(f);
+
+    printf("%s: %llu references (%llu reads, %llu writes), %llu bytes, "
+           "page size %u\n",
+           path, reads + writes, reads, writes, bytes, h.pageSize);
+    return 0;
+}
@@ -0,0 +1,188 @@
+/// A binary min-heap of items keyed by non-negative integers.
+///
+/// Items with equal keys come out in the order they were inserted.  Items
+/// are stored by value in a single array that grows as needed and is never
+/// shrunk, so once the heap has reached its working size, inserting and
+/// removing items does not allocate memory.
+///
+/// Copyright (c) 2018-2020 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+#ifndef NACHOS_LIB_HEAP__HH
+#define NACHOS_LIB_HEAP__HH
+
+
+#include "utility.hh"
+
+
+template <class Item>
+class Heap {
+public:
+
+    /// Initialize an empty heap.
+    Heap();
+
+    /// De-allocate the heap.
+    ~Heap();
+
+    /// Put `item` into the heap, with priority `key`.
+    void Insert(Item item, unsigned long key);
+
+    /// Return the item with the least key, without removing it.
+    ///
+    /// Returns `Item()` if the heap is empty.  Otherwise, if `keyPtr` is
+    /// not null, sets `*keyPtr` to the key of the item.
+    Item Head(unsigned long *keyPtr) const;
+
+    /// Remove the item with the least key, and return it.
+    ///
+    /// Same conventions as `Head`.
+    Item Pop(unsigned long *keyPtr);
+
+    /// Is the heap empty?
+    bool IsEmpty() const;
+
+    /// Number of items in the heap.
+    unsigned Length() const;
+
+    /// Apply `func` to all items in the heap, in no particular order.
+    void Apply(void (*func)(Item)) const;
+
+private:
+
+    struct Node {
+        Item item;
+        unsigned long key;
+        unsigned long order;  ///< Insertion number, to break ties.
+    };
+
+    /// Is node `a` to come out before node `b`?
+    static bool Before(const Node &a, const Node &b);
+
+    Node *nodes;
+    unsigned size;
+    unsigned capacity;
+    unsigned long nextOrder;
+};
+
+
+template <class Item>
+Heap<Item>::Heap()
+{
+    capacity  = 16;
+    nodes     = new Node [capacity];
+    size      = 0;
+    nextOrder = 0;
+}
+
+template <class Item>
+Heap<Item>::~Heap()
+{
+    delete [] nodes;
+}
+
+template <class Item>
+bool
+Heap<Item>::Before(const Node &a, const Node &b)
+{
+    return a.key < b.key || (a.key == b.key && a.order < b.order);
+}
+
+/// Sift the new item up from the last leaf.
+///
+/// * `item` is the thing to put on the heap.
+/// * `key` is the priority of the item; lower keys come out first.
+template <class Item>
+void
+Heap<Item>::Insert(Item item, unsigned long key)
+{
+    if (size == capacity) {
+        Node *old = nodes;
+        capacity *= 2;
+        nodes = new Node [capacity];
+        for (unsigned i = 0; i < size; i++)
+            nodes[i] = old[i];
+        delete [] old;
+    }
+
+    Node node;
+    node.item  = item;
+    node.key   = key;
+    node.order = nextOrder++;
+
+    unsigned i = size++;
+    while (i > 0 && Before(node, nodes[(i - 1) / 2])) {
+        nodes[i] = nodes[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    nodes[i] = node;
+}
+
+template <class Item>
+Item
+Heap<Item>::Head(unsigned long *keyPtr) const
+{
+    if (IsEmpty())
+        return Item();
+
+    if (keyPtr != nullptr)
+        *keyPtr = nodes[0].key;
+    return nodes[0].item;
+}
+
+/// Take the root out, and sift the last leaf down from the root.
+template <class Item>
+Item
+Heap<Item>::Pop(unsigned long *keyPtr)
+{
+    if (IsEmpty())
+        return Item();
+
+    Item thing = nodes[0].item;
+    if (keyPtr != nullptr)
+        *keyPtr = nodes[0].key;
+
+    Node last = nodes[--size];
+    unsigned i = 0;
+    for (;;) {
+        unsigned child = 2 * i + 1;
+        if (child >= size)
+            break;
+        if (child + 1 < size && Before(nodes[child + 1], nodes[child]))
+            child++;
+        if (!Before(nodes[child], last))
+            break;
+        nodes[i] = nodes[child];
+        i = child;
+    }
+    nodes[i] = last;
+    return thing;
+}
+
+template <class Item>
+bool
+Heap<Item>::IsEmpty() const
+{
+    return size == 0;
+}
+
+template <class Item>
+unsigned
+Heap<Item>::Length() const
+{
+    return size;
+}
+
+template <class Item>
+void
+Heap<Item>::Apply(void (*func)(Item)) const
+{
+    ASSERT(func != nullptr);
+
+    for (unsigned i = 0; i < size; i++)
+        func(nodes[i].item);
+}
+
+
+#endif
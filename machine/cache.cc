@@ -0,0 +1,99 @@
+/// Copyright (c) 2016-2020 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+
+#include "cache.hh"
+#include "lib/utility.hh"
+
+
+static inline bool
+IsPowerOfTwo(unsigned n)
+{
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+Cache::Cache(unsigned size, unsigned lineSize, unsigned ways_,
+             bool writeBack_)
+{
+    ASSERT(IsPowerOfTwo(size));
+    ASSERT(IsPowerOfTwo(lineSize) && lineSize >= 4);
+    ASSERT(IsPowerOfTwo(ways_) && ways_ * lineSize <= size);
+
+    lineShift = 0;
+    while (1U << lineShift < lineSize)
+        lineShift++;
+    ways      = ways_;
+    numSets   = size / lineSize / ways;
+    writeBack = writeBack_;
+    clock     = 0;
+
+    lines = new Line [numSets * ways];
+    for (unsigned i = 0; i < numSets * ways; i++) {
+        lines[i].valid   = false;
+        lines[i].dirty   = false;
+        lines[i].lastUse = 0;
+    }
+}
+
+Cache::~Cache()
+{
+    delete [] lines;
+}
+
+unsigned
+Cache::Access(unsigned addr, bool writing)
+{
+    unsigned tag = addr >> lineShift;
+    Line *set = &lines[(tag & (numSets - 1)) * ways];
+    clock++;
+
+    Line *victim = &set[0];
+    for (unsigned i = 0; i < ways; i++) {
+        Line *line = &set[i];
+        if (line->valid && line->tag == tag) {
+            line->lastUse = clock;
+            if (!writing)
+                return 0;
+            if (writeBack) {
+                line->dirty = true;
+                return 0;
+            }
+            return CACHE_MEMORY_WRITE;
+        }
+        if (victim->valid
+              && (!line->valid || line->lastUse < victim->lastUse))
+            victim = line;
+    }
+
+    if (writing && !writeBack)  // Write around the cache.
+        return CACHE_MISS | CACHE_MEMORY_WRITE;
+
+    unsigned events = CACHE_MISS;
+    if (victim->valid && victim->dirty)
+        events |= CACHE_MEMORY_WRITE;
+    victim->tag     = tag;
+    victim->valid   = true;
+    victim->dirty   = writing;
+    victim->lastUse = clock;
+    return events;
+}
+
+unsigned
+Cache::Invalidate(unsigned addr, unsigned size)
+{
+    unsigned first = addr >> lineShift;
+    unsigned last  = (addr + size - 1) >> lineShift;
+    unsigned dirty = 0;
+    for (unsigned tag = first; tag <= last; tag++) {
+        Line *set = &lines[(tag & (numSets - 1)) * ways];
+        for (unsigned i = 0; i < ways; i++)
+            if (set[i].valid && set[i].tag == tag) {
+                if (set[i].dirty)
+                    dirty++;
+                set[i].valid = false;
+                set[i].dirty = false;
+            }
+    }
+    return dirty;
+}
@@ -0,0 +1,74 @@
+/// Simulation of a level 1 cache of main memory.
+///
+/// Only the tags are simulated: the data always come from `mainMemory`, so
+/// a cache just tells whether each reference would have hit, for the
+/// statistics and the cost model.  Caches are indexed and tagged by
+/// physical address, and replace the least recently used line of a set.
+///
+/// A write back cache loads the line a write misses, and writes a line
+/// back to memory when a dirty one is replaced.  A write through cache
+/// writes every write to memory, and does not load lines on write misses.
+///
+/// Copyright (c) 2016-2020 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+#ifndef NACHOS_MACHINE_CACHE__HH
+#define NACHOS_MACHINE_CACHE__HH
+
+
+/// What an access to a cache took, besides looking the line up.
+enum CacheEvent {
+    CACHE_MISS         = 1,  ///< The line was not in the cache.
+    CACHE_MEMORY_WRITE = 2   ///< Memory was written: a dirty line was
+                             ///< written back, or the cache writes
+                             ///< through.
+};
+
+class Cache {
+public:
+
+    /// A cache of `size` bytes, in lines of `lineSize` bytes grouped in
+    /// sets of `ways` lines.
+    ///
+    /// All three must be powers of two, with lines of at least a word.
+    Cache(unsigned size, unsigned lineSize, unsigned ways, bool writeBack);
+
+    ~Cache();
+
+    /// Look up the line holding physical address `addr`, for a read or a
+    /// write, and load it if needed.
+    ///
+    /// Returns the `CacheEvent`s that happened, or'ed together.
+    unsigned Access(unsigned addr, bool writing);
+
+    /// Drop the lines of the `size` bytes at physical address `addr`, as
+    /// their contents are about to be replaced.
+    ///
+    /// Returns how many of them were dirty, and would have been written
+    /// back to memory first.
+    unsigned Invalidate(unsigned addr, unsigned size);
+
+private:
+
+    struct Line {
+        unsigned tag;
+        bool valid;
+        bool dirty;
+        unsigned long lastUse;  ///< Value of `clock` at the last access.
+    };
+
+    unsigned lineShift;  ///< Bits of the offset within a line.
+    unsigned numSets;
+    unsigned ways;
+    bool writeBack;
+
+    /// The lines of each set, one set after another.
+    Line *lines;
+
+    /// Accesses so far, to tell which line was used least recently.
+    unsigned long clock;
+};
+
+
+#endif
@@ -102,12 +102,24 @@ Console::CheckCharAvail()
     interrupt->Schedule(ConsoleReadPoll, this,
             CONSOLE_TIME, CONSOLE_READ_INT);
 
-    // Do nothing if character is already buffered, or none to be read.
-    if (incoming != EOF || !SystemDep::PollFile(readFileNo))
+    // Do nothing if character is already buffered.
+    if (incoming != EOF)
         return;
 
-    // Otherwise, read character and tell user about it.
-    SystemDep::Read(readFileNo, &c, sizeof c);
+    // When replaying, the character comes from the log, if one came then.
+    Replay *replay = interrupt->GetReplay();
+    if (replay != nullptr && replay->IsReplaying()) {
+        if (replay->Play(&c, sizeof c) == 0)
+            return;
+    } else {
+        if (!SystemDep::PollFile(readFileNo))  // None to be read.
+            return;
+        SystemDep::Read(readFileNo, &c, sizeof c);
+        if (replay != nullptr)
+            replay->Record(&c, sizeof c);
+    }
+
+    // Otherwise, tell user about the character.
     incoming = c;
     stats->numConsoleCharsRead++;
     (*readHandler)(handlerArg);
@@ -0,0 +1,80 @@
+/// Copyright (c) 2016-2020 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+
+#include "cost_model.hh"
+#include "statistics.hh"
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+
+CostModel::CostModel()
+{
+    for (unsigned i = 0; i <= MAX_OPCODE; i++)
+        instruction[i] = USER_TICK;
+    tlbRefill   = 0;
+    pageFault   = 0;
+    cacheMiss   = 0;
+    memoryWrite = 0;
+}
+
+/// Return the cost called `name`, or null if there is none.
+static unsigned long *
+FindCost(CostModel *model, const char *name)
+{
+    if (strcasecmp(name, "tlbrefill") == 0)
+        return &model->tlbRefill;
+    if (strcasecmp(name, "pagefault") == 0)
+        return &model->pageFault;
+    if (strcasecmp(name, "cachemiss") == 0)
+        return &model->cacheMiss;
+    if (strcasecmp(name, "memorywrite") == 0)
+        return &model->memoryWrite;
+
+    // The mnemonic is what `OP_STRINGS` prints before the operands.
+    size_t length = strlen(name);
+    for (unsigned i = 1; i <= MAX_OPCODE; i++) {
+        const char *s = OP_STRINGS[i].string;
+        if (strncasecmp(s, name, length) == 0
+              && (s[length] == ' ' || s[length] == '\0'))
+            return &model->instruction[i];
+    }
+    return nullptr;
+}
+
+bool
+CostModel::Load(const char *fileName)
+{
+    FILE *f = fopen(fileName, "r");
+    if (f == nullptr) {
+        fprintf(stderr, "Unable to open cost model `%s`.\n", fileName);
+        return false;
+    }
+
+    char line[128];
+    unsigned lineNumber = 0;
+    while (fgets(line, sizeof line, f) != nullptr) {
+        lineNumber++;
+        char name[32], rest[2];
+        unsigned long ticks;
+        int fields = sscanf(line, "%31s %lu %1s", name, &ticks, rest);
+        if (fields <= 0 || name[0] == '#')
+            continue;
+
+        unsigned long *cost = fields == 2 ? FindCost(this, name) : nullptr;
+        if (cost == nullptr) {
+            fprintf(stderr, "%s:%u: expected an instruction, `tlbrefill`,"
+                    " `pagefault`, `cachemiss` or `memorywrite`, and a"
+                    " number of ticks.\n",
+                    fileName, lineNumber);
+            fclose(f);
+            return false;
+        }
+        *cost = ticks;
+    }
+    fclose(f);
+    return true;
+}
@@ -0,0 +1,58 @@
+/// Model of the simulated time user programs take.
+///
+/// Each kind of instruction takes a number of ticks of its own, and the
+/// instruction that causes a TLB refill, a page fault, a cache miss or a
+/// write to memory stalls for some more.  By default every instruction
+/// takes `USER_TICK` and nothing stalls, which is the timing of the
+/// original Nachos.
+///
+/// Copyright (c) 2016-2020 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+#ifndef NACHOS_MACHINE_COSTMODEL__HH
+#define NACHOS_MACHINE_COSTMODEL__HH
+
+
+#include "encoding.hh"
+
+
+class CostModel {
+public:
+
+    /// Make every instruction take `USER_TICK`, with no stalls.
+    CostModel();
+
+    /// Read costs from host file `fileName`, leaving the others alone.
+    ///
+    /// Each line holds a name and a number of ticks.  The name is the
+    /// mnemonic of an instruction (as printed by the `m` debug flag, in any
+    /// case), `tlbrefill`, `pagefault`, `cachemiss` or `memorywrite`.
+    /// Blank lines and lines starting with `#` are skipped.
+    ///
+    /// Return false, after telling why, if the file cannot be read or has a
+    /// malformed line.
+    bool Load(const char *fileName);
+
+    /// Ticks taken by each instruction, indexed by `Instruction::opCode`.
+    unsigned long instruction[MAX_OPCODE + 1];
+
+    /// Ticks stalled by an instruction whose translation is loaded into
+    /// the TLB, by the kernel or the page table walker.
+    unsigned long tlbRefill;
+
+    /// Ticks stalled by an instruction whose page must be brought into
+    /// memory.
+    unsigned long pageFault;
+
+    /// Ticks stalled by an instruction for each line it misses in a
+    /// cache.
+    unsigned long cacheMiss;
+
+    /// Ticks stalled by an instruction for each write of its to reach
+    /// memory, written through or back from a cache.
+    unsigned long memoryWrite;
+};
+
+
+#endif
@@ -0,0 +1,126 @@
+/// Routines to manage the cache of decoded instructions.
+///
+/// Copyright (c) 2016-2020 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+
+#include "decode_cache.hh"
+#include "endianness.hh"
+#include "lib/utility.hh"
+
+
+/// Initialize the cache with no decoded instructions.
+///
+/// * `numFrames` is the number of physical frames in main memory.
+/// * `frameSize` is the size of each frame, in bytes.
+DecodeCache::DecodeCache(unsigned numFrames_, unsigned frameSize_)
+{
+    ASSERT(frameSize_ % 4 == 0);
+
+    numFrames     = numFrames_;
+    frameSize     = frameSize_;
+    slotsPerFrame = frameSize / 4;
+
+    // Like main memory, the slots are mapped zero-filled, so that frames
+    // never run from cost nothing: all zeros means invalid and unknown.
+    unsigned numSlots = numFrames * slotsPerFrame;
+    slots       = (Instruction *) SystemDep::MapZeroed(
+                    numSlots * sizeof *slots);
+    slotValid   = (bool *) SystemDep::MapZeroed(numSlots * sizeof *slotValid);
+    blockLength = (unsigned *) SystemDep::MapZeroed(
+                    numSlots * sizeof *blockLength);
+    frameCached = (bool *) SystemDep::MapZeroed(
+                    numFrames * sizeof *frameCached);
+    generation = 0;
+}
+
+DecodeCache::~DecodeCache()
+{
+    unsigned numSlots = numFrames * slotsPerFrame;
+    SystemDep::Unmap(slots, numSlots * sizeof *slots);
+    SystemDep::Unmap(slotValid, numSlots * sizeof *slotValid);
+    SystemDep::Unmap(blockLength, numSlots * sizeof *blockLength);
+    SystemDep::Unmap(frameCached, numFrames * sizeof *frameCached);
+}
+
+/// Return the decoded instruction stored at `physAddr`.
+///
+/// * `memory` is the start of main memory.
+/// * `physAddr` is the physical address of the instruction; it must be
+///   aligned to a word boundary.
+const Instruction *
+DecodeCache::Get(const char *memory, unsigned physAddr)
+{
+    ASSERT(memory != nullptr);
+    ASSERT((physAddr & 0x3) == 0);
+
+    unsigned slot = physAddr / 4;
+    ASSERT(slot < numFrames * slotsPerFrame);
+
+    Instruction *instr = &slots[slot];
+    if (!slotValid[slot]) {
+        instr->value = WordToHost(*(const unsigned *) &memory[physAddr]);
+        instr->Decode();
+        slotValid[slot] = true;
+        frameCached[slot / slotsPerFrame] = true;
+    }
+    return instr;
+}
+
+/// Return the basic block starting at `physAddr`, decoding whatever part
+/// of it is not yet in the cache.
+///
+/// * `memory` is the start of main memory.
+/// * `physAddr` is the physical address of the first instruction.
+/// * `length` is the place to store the number of instructions in the
+///   block.
+const Instruction *
+DecodeCache::GetBlock(const char *memory, unsigned physAddr,
+                      unsigned *length)
+{
+    ASSERT(length != nullptr);
+
+    const Instruction *first = Get(memory, physAddr);
+    unsigned slot = physAddr / 4;
+
+    if (blockLength[slot] == 0) {
+        unsigned end = (slot / slotsPerFrame + 1) * slotsPerFrame;
+        unsigned last = slot;
+        while (last + 1 < end && !slots[last].EndsBlock()) {
+            last++;
+            Get(memory, last * 4);
+        }
+        unsigned char op = slots[last].opCode;
+        if (slots[last].EndsBlock() && last + 1 < end && op != OP_SYSCALL
+              && op != OP_RES && op != OP_UNIMP) {
+            last++;  // Include the delay slot of the branch.
+            Get(memory, last * 4);
+        }
+        blockLength[slot] = last - slot + 1;
+    }
+
+    *length = blockLength[slot];
+    return first;
+}
+
+/// Invalidate all the decoded instructions of `frame`.
+///
+/// Must be called whenever the contents of the frame change behind the
+/// back of the MMU, for instance when it is loaded from a file.
+void
+DecodeCache::InvalidateFrame(unsigned frame)
+{
+    ASSERT(frame < numFrames);
+
+    if (!frameCached[frame])
+        return;
+
+    unsigned first = frame * slotsPerFrame;
+    for (unsigned i = first; i < first + slotsPerFrame; i++) {
+        slotValid[i]   = false;
+        blockLength[i] = 0;
+    }
+    frameCached[frame] = false;
+    generation++;
+}
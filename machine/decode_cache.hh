@@ -0,0 +1,104 @@
+/// Data structures to avoid decoding the same user instruction over and
+/// over again.
+///
+/// Every word fetched by the simulated CPU used to go through
+/// `Instruction::Decode`, even inside tight loops.  The decode cache keeps
+/// the already decoded form of the instructions found in each physical
+/// frame of main memory, so that a fetch only needs to translate the
+/// program counter.
+///
+/// Entries are invalidated by the MMU when a cached frame is written, and
+/// by the kernel when a frame is reassigned to another virtual page.
+///
+/// Copyright (c) 2016-2020 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+#ifndef NACHOS_MACHINE_DECODECACHE__HH
+#define NACHOS_MACHINE_DECODECACHE__HH
+
+
+#include "instruction.hh"
+
+
+/// The following class defines a cache of decoded instructions, indexed by
+/// physical address.
+///
+/// The cache is split in frames of the same size as the pages of main
+/// memory.  A frame is marked as cached as soon as one of its words is
+/// decoded, so that writes to frames holding only data are cheap to check.
+class DecodeCache {
+public:
+
+    /// Initialize an empty cache for `numFrames` frames of `frameSize`
+    /// bytes each.
+    DecodeCache(unsigned numFrames, unsigned frameSize);
+
+    /// De-allocate the cache.
+    ~DecodeCache();
+
+    /// Return the decoded instruction found at `physAddr` in `memory`.
+    ///
+    /// The word is decoded only if it is not already in the cache.
+    const Instruction *Get(const char *memory, unsigned physAddr);
+
+    /// Return the basic block starting at `physAddr` in `memory`.
+    ///
+    /// A block extends up to the first instruction that may branch (plus
+    /// its delay slot), or up to the end of the frame.  Its instructions
+    /// are consecutive in the returned array, and `*length` is set to how
+    /// many there are.
+    const Instruction *GetBlock(const char *memory, unsigned physAddr,
+                                unsigned *length);
+
+    /// Number of times a frame has been invalidated.
+    ///
+    /// Lets the threaded engine notice that a block it is running may have
+    /// been overwritten.
+    unsigned long GetGeneration() const;
+
+    /// Drop the frame containing `physAddr` if it holds decoded
+    /// instructions.  Called on every write to main memory.
+    void NoteWrite(unsigned physAddr);
+
+    /// Forget every decoded instruction of a frame.
+    void InvalidateFrame(unsigned frame);
+
+private:
+
+    /// Number of frames and words per frame.
+    unsigned numFrames;
+    unsigned frameSize;
+    unsigned slotsPerFrame;
+
+    /// Decoded instructions, one slot per word of main memory.
+    Instruction *slots;
+
+    /// Whether each slot holds a valid decoding.
+    bool *slotValid;
+
+    /// Length of the block starting at each slot, or 0 if unknown.
+    unsigned *blockLength;
+
+    /// Whether each frame has at least one valid slot.
+    bool *frameCached;
+
+    unsigned long generation;
+};
+
+inline unsigned long
+DecodeCache::GetGeneration() const
+{
+    return generation;
+}
+
+inline void
+DecodeCache::NoteWrite(unsigned physAddr)
+{
+    unsigned frame = physAddr / frameSize;
+    if (frameCached[frame])
+        InvalidateFrame(frame);
+}
+
+
+#endif
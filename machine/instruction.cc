@@ -47,6 +47,33 @@ Instruction::Decode()
         else
             opCode = OP_UNIMP;
     }
+
+    handler = INSTRUCTION_HANDLERS[opCode];
+}
+
+bool
+Instruction::EndsBlock() const
+{
+    switch (opCode) {
+        case OP_BEQ:
+        case OP_BGEZ:
+        case OP_BGEZAL:
+        case OP_BGTZ:
+        case OP_BLEZ:
+        case OP_BLTZ:
+        case OP_BLTZAL:
+        case OP_BNE:
+        case OP_J:
+        case OP_JAL:
+        case OP_JALR:
+        case OP_JR:
+        case OP_SYSCALL:
+        case OP_RES:
+        case OP_UNIMP:
+            return true;
+        default:
+            return false;
+    }
 }
 
 int
@@ -10,6 +10,20 @@
 #include "encoding.hh"
 
 
+class Machine;
+class Instruction;
+
+/// Routine that executes one kind of instruction in the threaded engine
+/// (see `threaded_sim.cc`).
+///
+/// Returns false if the instruction raised an exception, and thus did not
+/// complete.
+typedef bool (*InstructionHandler)(Machine *machine, int *registers,
+                                   const Instruction *instr);
+
+/// Handlers for every value of `Instruction::opCode`.
+extern const InstructionHandler INSTRUCTION_HANDLERS[];
+
 /// The following class defines an instruction, represented in both:
 /// * undecoded binary form;
 /// * decoded to identify:
@@ -33,6 +47,13 @@ public:
     unsigned char rs, rt, rd;  ///< Three registers from instruction.
     int extra;  ///< Immediate or target or shamt field or offset.
                 ///< Immediates are sign-extended.
+
+    InstructionHandler handler;  ///< Routine that executes this
+                                 ///< instruction in the threaded engine.
+
+    /// Whether this instruction may transfer control somewhere other than
+    /// the next instruction (not counting exceptions on memory accesses).
+    bool EndsBlock() const;
 };
 
 
@@ -47,6 +47,14 @@ IsIntType(IntType t)
     return 0 <= t && t < NUM_INT_TYPES;
 }
 
+PendingInterrupt::PendingInterrupt()
+{
+    handler = nullptr;
+    arg     = nullptr;
+    when    = 0;
+    type    = TIMER_INT;
+}
+
 /// Initialize a hardware device interrupt that is to be scheduled to occur
 /// in the near future.
 ///
@@ -66,24 +74,47 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, void *param,
     type    = kind;
 }
 
+/// CPU driven by each host thread.
+static thread_local unsigned currentCpu = 0;
+
+/// Set `cpu` to the state a CPU starts in.
+static void
+ResetCpu(CpuState *cpu)
+{
+    cpu->level         = INT_OFF;
+    cpu->inHandler     = false;
+    cpu->yieldOnReturn = false;
+    cpu->status        = SYSTEM_MODE;
+    cpu->inKernel      = false;
+    cpu->idle          = false;
+}
+
 /// Initialize the simulation of hardware device interrupts.
 ///
 /// Interrupts start disabled, with no interrupts pending, etc.
 Interrupt::Interrupt()
 {
-    level         = INT_OFF;
-    pending       = new List<PendingInterrupt *>;
-    inHandler     = false;
-    yieldOnReturn = false;
-    status        = SYSTEM_MODE;
+    pending = new Heap<PendingInterrupt>;
+    nextDue = ULONG_MAX;
+    numCpus = 1;
+    cpus    = new CpuState [MAX_CPUS];
+    replay  = nullptr;
+    for (unsigned i = 0; i < MAX_CPUS; i++)
+        ResetCpu(&cpus[i]);
 }
 
 /// De-allocate the data structures needed by the interrupt simulation.
 Interrupt::~Interrupt()
 {
-    while (!pending->IsEmpty())
-        delete pending->Pop();
     delete pending;
+    delete [] cpus;
+    delete replay;
+}
+
+inline CpuState &
+Interrupt::Current() const
+{
+    return cpus[currentCpu];
 }
 
 /// Change interrupts to be enabled or disabled, without advancing the
@@ -99,7 +130,7 @@ Interrupt::ChangeLevel(IntStatus old, IntStatus now)
     ASSERT(IsIntStatus(old));
     ASSERT(IsIntStatus(now));
 
-    level = now;
+    Current().level = now;
     DEBUG('i', "Interrupts %s\n", INT_LEVEL_NAMES[now]);
 }
 
@@ -114,10 +145,10 @@ Interrupt::SetLevel(IntStatus now)
 {
     ASSERT(IsIntStatus(now));
 
-    IntStatus old = level;
+    IntStatus old = Current().level;
 
     /// Interrupt handlers are prohibited from enabling interrupts.
-    ASSERT(now == INT_OFF || !inHandler);
+    ASSERT(now == INT_OFF || !Current().inHandler);
 
     ChangeLevel(old, now);  /// Change to new state.
     if (now == INT_ON && old == INT_OFF)
@@ -141,34 +172,149 @@ Interrupt::Enable()
 /// Two things can cause `OneTick` to be called:
 /// * interrupts are re-enabled;
 /// * a user instruction is executed.
-void
-Interrupt::OneTick()
+///
+/// Returns true if an interrupt handler ran, so that the machine knows its
+/// state may have changed under it.
+bool
+Interrupt::OneTick(unsigned long userTicks)
 {
-    MachineStatus old = status;
+    CpuState &cpu = Current();
+    MachineStatus old = cpu.status;
 
     // Advance simulated time.
-    if (status == SYSTEM_MODE) {
+    if (old == SYSTEM_MODE) {
         stats->totalTicks += SYSTEM_TICK;
     stats->systemTicks += SYSTEM_TICK;
     } else {  // USER_PROGRAM
-    stats->totalTicks += USER_TICK;
-    stats->userTicks += USER_TICK;
+    stats->totalTicks += userTicks;
+    stats->userTicks += userTicks;
     }
     DEBUG('i', "== Tick %u ==\n", stats->totalTicks);
 
-    // Check any pending interrupts are now ready to fire.
-    ChangeLevel(INT_ON, INT_OFF);  // First, turn off interrupts (interrupt
-                                   // handlers run with interrupts disabled).
-    while (CheckIfDue(false))      // Check for pending interrupts.
-        ;
-    ChangeLevel(INT_OFF, INT_ON);  // Re-enable interrupts.
-    if (yieldOnReturn) {           // If the timer device handler asked for a
-                                   // context switch, ok to do it now.
-        yieldOnReturn = false;
-        status = SYSTEM_MODE;      // Yield is a kernel routine.
-        currentThread->Yield();
-        status = old;
+    // Check any pending interrupts are now ready to fire.  Most of the
+    // time none is, which the cached deadline tells at once.
+    bool fired = false;
+    if (stats->totalTicks >= nextDue || debug.IsEnabled('i')) {
+        ChangeLevel(INT_ON, INT_OFF);  // First, turn off interrupts
+                                       // (interrupt handlers run with
+                                       // interrupts disabled).
+        while (CheckIfDue(false))      // Check for pending interrupts.
+            fired = true;
+        ChangeLevel(INT_OFF, INT_ON);  // Re-enable interrupts.
+    }
+    // If the timer device handler asked for a context switch, ok to do it
+    // now, unless the scheduler lets the thread run on.
+    if (cpu.yieldOnReturn) {
+        cpu.yieldOnReturn = false;
+        if (scheduler->SliceExpired()) {
+            cpu.status = SYSTEM_MODE;  // Yield is a kernel routine.
+            currentThread->Yield();
+            cpu.status = old;
+        }
+    }
+    return fired;
+}
+
+/// Return how many user ticks can pass before the next pending interrupt is
+/// due.
+///
+/// Returns 0 while tracing interrupts, so that every tick is shown.  With
+/// more than one CPU, the ticks are split evenly among them, as all of them
+/// advance the same clock; an interrupt scheduled sooner meanwhile waits
+/// until the other CPUs use up their share, or trap into the kernel.
+unsigned long
+Interrupt::UserTicksBeforeDue() const
+{
+    if (debug.IsEnabled('i'))
+        return 0;
+
+    if (nextDue == ULONG_MAX)
+        return ULONG_MAX;  // Nothing can interrupt us.
+    if (nextDue <= stats->totalTicks)
+        return 0;
+    return (nextDue - stats->totalTicks - 1) / numCpus;
+}
+
+/// Charge `n` user ticks at once.
+///
+/// The caller must make sure that no interrupt would have been due during
+/// those ticks (see `UserTicksBeforeDue`).
+void
+Interrupt::ChargeUserTicks(unsigned long n)
+{
+    stats->totalTicks += n;
+    stats->userTicks  += n;
+}
+
+/// Pop every pending interrupt into `list`, soonest first.
+///
+/// Returns how many there were; there must be room for all of them.
+static unsigned
+PopAll(Heap<PendingInterrupt> *heap, PendingInterrupt *list, unsigned max)
+{
+    unsigned n = 0;
+    while (!heap->IsEmpty()) {
+        ASSERT(n < max);
+        list[n++] = heap->Pop(nullptr);
+    }
+    return n;
+}
+
+unsigned
+Interrupt::SavePending(IntType *types, unsigned long *times, unsigned max)
+{
+    ASSERT(types != nullptr);
+    ASSERT(times != nullptr);
+
+    unsigned n = pending->Length();
+    PendingInterrupt *list = new PendingInterrupt [n];
+    PopAll(pending, list, n);
+    for (unsigned i = 0; i < n; i++) {
+        if (i < max) {
+            types[i] = list[i].type;
+            times[i] = list[i].when;
+        }
+        pending->Insert(list[i], list[i].when);  // In the same order.
     }
+    delete [] list;
+    return n;
+}
+
+void
+Interrupt::RestorePending(const IntType *types, const unsigned long *times,
+                          unsigned n, unsigned long now)
+{
+    ASSERT(n == 0 || (types != nullptr && times != nullptr));
+
+    unsigned length = pending->Length();
+    PendingInterrupt *list = new PendingInterrupt [length];
+    PopAll(pending, list, length);
+
+    bool *taken = new bool [n];
+    for (unsigned j = 0; j < n; j++)
+        taken[j] = false;
+
+    nextDue = ULONG_MAX;
+    for (unsigned i = 0; i < length; i++) {
+        unsigned j = 0;
+        while (j < n && (taken[j] || types[j] != list[i].type))
+            j++;
+        if (j < n) {
+            taken[j] = true;
+            list[i].when = times[j];
+        } else {
+            DEBUG('i', "No saved time for the %s interrupt\n",
+                  INT_TYPE_NAMES[list[i].type]);
+            unsigned long ahead = list[i].when > stats->totalTicks
+                                  ? list[i].when - stats->totalTicks : 0;
+            list[i].when = now + ahead;
+        }
+        pending->Insert(list[i], list[i].when);
+        if (list[i].when < nextDue)
+            nextDue = list[i].when;
+    }
+    delete [] taken;
+    delete [] list;
 }
 
 /// Called from within an interrupt handler, to cause a context switch (for
@@ -181,7 +327,144 @@ void
 Interrupt::YieldOnReturn()
 {
     //ASSERT(inHandler);
-    yieldOnReturn = true;
+    Current().yieldOnReturn = true;
+}
+
+/// Called from within the timer interrupt handler, to have every CPU that
+/// is not idle switch threads.
+///
+/// The other CPUs do it the next time they check for interrupts.
+void
+Interrupt::YieldAllOnReturn()
+{
+    for (unsigned i = 0; i < numCpus; i++)
+        if (i == currentCpu ? cpus[i].status != IDLE_MODE : !cpus[i].idle)
+            cpus[i].yieldOnReturn = true;
+}
+
+/// Give the machine `n` CPUs.
+///
+/// Must be called once, before any other host thread calls `BootCpu`.  The
+/// calling thread drives CPU 0, and keeps the kernel lock.
+void
+Interrupt::SetNumCpus(unsigned n)
+{
+    ASSERT(numCpus == 1);
+    ASSERT(n >= 1 && n <= MAX_CPUS);
+
+    numCpus = n;
+    if (n > 1) {
+        kernelLock.lock();
+        Current().inKernel = true;
+    }
+}
+
+unsigned
+Interrupt::GetNumCpus() const
+{
+    return numCpus;
+}
+
+void
+Interrupt::SetReplay(Replay *r)
+{
+    ASSERT(numCpus == 1);
+    replay = r;
+}
+
+Replay *
+Interrupt::GetReplay() const
+{
+    return replay;
+}
+
+unsigned
+Interrupt::GetCpu() const
+{
+    return currentCpu;
+}
+
+/// Start driving `cpu` from the calling host thread.
+///
+/// Returns holding the kernel lock, with the CPU in kernel mode and
+/// interrupts disabled.
+void
+Interrupt::BootCpu(unsigned cpu)
+{
+    ASSERT(cpu > 0 && cpu < numCpus);
+
+    currentCpu = cpu;
+    kernelLock.lock();
+    Current().inKernel = true;
+    DEBUG('i', "CPU %u booted\n", cpu);
+}
+
+/// Take the kernel lock, unless this CPU already holds it.
+///
+/// A no-op with a single CPU.
+bool
+Interrupt::EnterKernel()
+{
+    if (numCpus == 1 || Current().inKernel)
+        return false;
+    kernelLock.lock();
+    Current().inKernel = true;
+    return true;
+}
+
+/// Release the kernel lock, so that other CPUs may run kernel code while
+/// this one runs user code.
+void
+Interrupt::LeaveKernel()
+{
+    if (numCpus == 1)
+        return;
+    ASSERT(Current().inKernel);
+    Current().inKernel = false;
+    kernelLock.unlock();
+}
+
+/// Mark `cpu` as no longer idle, and wake it up if it is waiting in
+/// `Idle`.
+///
+/// Must be called with the kernel lock held.
+void
+Interrupt::WakeCpu(unsigned cpu)
+{
+    ASSERT(cpu < numCpus);
+
+    if (cpus[cpu].idle) {
+        DEBUG('i', "Waking up CPU %u\n", cpu);
+        cpus[cpu].idle = false;
+        cpuWoken.notify_all();
+    }
+}
+
+/// Wait until `WakeCpu` is called for this CPU, letting go of the kernel
+/// lock meanwhile.
+///
+/// While some other CPU is still running, it keeps simulated time going and
+/// fires the pending interrupts.  The last CPU to become idle does not
+/// wait, but returns false so that `Idle` advances the clock itself.
+bool
+Interrupt::WaitForWork()
+{
+    CpuState &cpu = Current();
+
+    bool allIdle = true;
+    for (unsigned i = 0; i < numCpus; i++)
+        if (i != currentCpu && !cpus[i].idle)
+            allIdle = false;
+    if (allIdle)
+        return false;
+
+    DEBUG('i', "CPU %u waiting for a ready thread\n", currentCpu);
+    cpu.idle = true;
+    std::unique_lock<std::mutex> lock(kernelLock, std::adopt_lock);
+    while (cpu.idle)
+        cpuWoken.wait(lock);
+    lock.release();  // Keep holding it.
+    return true;
 }
 
 /// Routine called when there is nothing in the ready queue.
@@ -196,12 +479,18 @@ void
 Interrupt::Idle()
 {
     DEBUG('i', "Machine idling; checking for interrupts.\n");
-    status = IDLE_MODE;
+    CpuState &cpu = Current();
+    cpu.status = IDLE_MODE;
+    if (numCpus > 1 && WaitForWork()) {  // Some other CPU made a thread
+        cpu.yieldOnReturn = false;       // ready for this one.
+        cpu.status = SYSTEM_MODE;
+        return;
+    }
     if (CheckIfDue(true)) {        // Check for any pending interrupts.
         while (CheckIfDue(false))  // Check for any other pending interrupts.
-        yieldOnReturn = false;     // Since there is nothing in the ready
+        cpu.yieldOnReturn = false; // Since there is nothing in the ready
                                    // queue, the yield is automatic.
-        status = SYSTEM_MODE;
+        cpu.status = SYSTEM_MODE;
         return;                    // Return in case there is now a runnable
                                    // thread.
     }
@@ -223,6 +512,16 @@ Interrupt::Halt()
 {
     printf("Machine halting!\n\n");
     stats->Print();
+    scheduler->PrintUsage();
+#ifdef USER_PROGRAM
+    // Other CPUs may still be running; their counts are taken as they are.
+    Profiler *profiler = cpuMachines[0]->GetProfiler();
+    if (profiler != nullptr) {
+        for (unsigned i = 1; i < numCpus; i++)
+            profiler->Merge(cpuMachines[i]->GetProfiler());
+        profiler->Report();
+    }
+#endif
     Cleanup();  // Never returns.
 }
 
@@ -236,20 +535,21 @@ Interrupt::Halt()
 void
 Interrupt::RestartTicks()
 {
-    List<PendingInterrupt *> *oldPending = pending;
-    pending = new List<PendingInterrupt *>;
-
-    PendingInterrupt *i;
-    unsigned          oldWhen = 0;
-    while ((i = oldPending->SortedPop((int *) &oldWhen)) != nullptr)
-    {
-        unsigned newWhen = oldWhen - stats->totalTicks;
-        pending->SortedInsert(i, newWhen);
-        DEBUG('x', "Interrupt at time %u re-scheduled at new time %u.\n",
-              oldWhen, newWhen);
+    Heap<PendingInterrupt> *oldPending = pending;
+    pending = new Heap<PendingInterrupt>;
+
+    while (!oldPending->IsEmpty()) {
+        PendingInterrupt i = oldPending->Pop(nullptr);
+        unsigned long oldWhen = i.when;
+        i.when = oldWhen - stats->totalTicks;
+        pending->Insert(i, i.when);
+        DEBUG('x', "Interrupt at time %lu re-scheduled at new time %lu.\n",
+              oldWhen, i.when);
     }
 
     delete oldPending;
+    if (nextDue != ULONG_MAX)
+        nextDue -= stats->totalTicks;
     stats->totalTicks = 0;
     stats->tickResets += 1;
 }
@@ -258,7 +558,8 @@ Interrupt::RestartTicks()
 /// Arrange for the CPU to be interrupted when simulated time reaches `now +
 /// when`.
 ///
-/// Implementation: just put it on a sorted list.
+/// Implementation: just put it on a heap, and remember if it is now the
+/// soonest one.
 ///
 /// NOTE: the Nachos kernel should not call this routine directly.  Instead,
 /// it is only called by the hardware device simulators.
@@ -288,13 +589,14 @@ Interrupt::Schedule(VoidFunctionPtr handler, void *arg,
 #endif
 
     unsigned when = stats->totalTicks + fromNow;
-    PendingInterrupt *toOccur = new PendingInterrupt(handler, arg,
-                                                     when, type);
+    PendingInterrupt toOccur(handler, arg, when, type);
 
     DEBUG('i', "Scheduling interrupt handler the %s at time = %u\n",
           INT_TYPE_NAMES[type], when);
 
-    pending->SortedInsert(toOccur, when);
+    pending->Insert(toOccur, when);
+    if (when < nextDue)
+        nextDue = when;
 }
 
 /// Check if an interrupt is scheduled to occur, and if so, fire it off.
@@ -308,76 +610,81 @@ Interrupt::Schedule(VoidFunctionPtr handler, void *arg,
 bool
 Interrupt::CheckIfDue(bool advanceClock)
 {
-    MachineStatus old = status;
-    unsigned      when;
+    CpuState &cpu = Current();
+    MachineStatus old = cpu.status;
 
-    ASSERT(level == INT_OFF);  // Interrupts need to be disabled, to invoke
+    ASSERT(cpu.level == INT_OFF);  // Interrupts need to be disabled, to invoke
                                // an interrupt handler.
     if (debug.IsEnabled('i'))
         DumpState();
-    PendingInterrupt *toOccur = pending->SortedPop((int *) &when);
 
-    if (toOccur == nullptr)  // No pending interrupts.
+    if (pending->IsEmpty())  // No pending interrupts.
     return false;
+    unsigned long when = nextDue;
 
     if (advanceClock && when > stats->totalTicks) {  // Advance the clock.
         stats->idleTicks += (when - stats->totalTicks);
         stats->totalTicks = when;
-    } else if (when > stats->totalTicks) {  // Not time yet, put it back.
-        pending->SortedInsert(toOccur, when);
+    } else if (when > stats->totalTicks)  // Not time yet, leave it there.
         return false;
-    }
 
     // Check if there is nothing more to do, and if so, quit.
-    if (status == IDLE_MODE && toOccur->type == TIMER_INT
-          && pending->IsEmpty()) {
-        pending->SortedInsert(toOccur, when);
+    PendingInterrupt toOccur = pending->Head(nullptr);
+    if (old == IDLE_MODE && toOccur.type == TIMER_INT
+          && pending->Length() == 1)
         return false;
-    }
 
-    DEBUG('i', "Invoking interrupt handler for the %s at time %u\n",
-            INT_TYPE_NAMES[toOccur->type], toOccur->when);
+    pending->Pop(nullptr);
+    pending->Head(&nextDue);
+    if (pending->IsEmpty())
+        nextDue = ULONG_MAX;
+
+    DEBUG('i', "Invoking interrupt handler for the %s at time %lu\n",
+            INT_TYPE_NAMES[toOccur.type], toOccur.when);
+    if (replay != nullptr && !replay->Deliver(toOccur.type, toOccur.when)) {
+        fprintf(stderr, "Replay diverged: the %s interrupt at time %lu is"
+                        " not the one logged.\n",
+                INT_TYPE_NAMES[toOccur.type], toOccur.when);
+        ASSERT(false);
+    }
 #ifdef USER_PROGRAM
     if (machine != nullptr)
         machine->DelayedLoad(0, 0);
 #endif
-    inHandler = true;
-    status = SYSTEM_MODE;  // Whatever we were doing, we are now going to be
-                           // running in the kernel.
-    (*toOccur->handler)(toOccur->arg);  // Call the interrupt handler.
-    status = old;  // Restore the machine status.
-    inHandler = false;
-    delete toOccur;
+    cpu.inHandler = true;
+    cpu.status = SYSTEM_MODE;  // Whatever we were doing, we are now going
+                               // to be running in the kernel.
+    (*toOccur.handler)(toOccur.arg);  // Call the interrupt handler.
+    cpu.status = old;  // Restore the machine status.
+    cpu.inHandler = false;
     return true;
 }
 
 IntStatus
 Interrupt::GetLevel() const
 {
-    return level;
+    return Current().level;
 }
 
 MachineStatus
 Interrupt::GetStatus() const
 {
-    return status;
+    return Current().status;
 }
 
 void
 Interrupt::SetStatus(MachineStatus st)
 {
-    status = st;
+    Current().status = st;
 }
 
 /// Print information about an interrupt that is scheduled to occur.  When,
 /// where, why, etc.
 static void
-PrintPending(PendingInterrupt *pend)
+PrintPending(PendingInterrupt pend)
 {
-    ASSERT(pend != nullptr);
-
     printf("    Handler %s, scheduled at %lu\n",
-           INT_TYPE_NAMES[pend->type], pend->when);
+           INT_TYPE_NAMES[pend.type], pend.when);
 }
 
 /// Print the complete interrupt state -- the status, and all interrupts that
@@ -386,11 +693,11 @@ void
 Interrupt::DumpState()
 {
     printf("Time: %lu, interrupts %s\n",
-           stats->totalTicks, INT_LEVEL_NAMES[level]);
+           stats->totalTicks, INT_LEVEL_NAMES[Current().level]);
     if (pending->IsEmpty())
         printf("No pending interrupts\n");
     else {
-        printf("Pending interrupts:\n");
+        printf("Pending interrupts (soonest at %lu):\n", nextDue);
         pending->Apply(PrintPending);
     }
 }
@@ -36,7 +36,12 @@
 #define NACHOS_MACHINE_INTERRUPT__HH
 
 
-#include "lib/list.hh"
+#include "replay.hh"
+#include "statistics.hh"
+#include "lib/heap.hh"
+
+#include <condition_variable>
+#include <mutex>
 
 
 /// Interrupts can be disabled (`INT_OFF`) or enabled (`INT_ON`).
@@ -77,6 +82,9 @@ enum IntType {
 class PendingInterrupt {
 public:
 
+    /// An empty slot, needed to store interrupts by value.
+    PendingInterrupt();
+
     /// initialize an interrupt that will occur in the future.
     PendingInterrupt(VoidFunctionPtr func, void *param,
                      unsigned long time, IntType kind);
@@ -89,6 +97,20 @@ public:
     IntType type;  ///< For debugging.
 };
 
+/// Most CPUs a machine can have.
+const unsigned MAX_CPUS = 16;
+
+/// Interrupt state of one CPU of the machine.
+struct CpuState {
+    IntStatus level;  ///< Are interrupts enabled or disabled?
+    bool inHandler;  ///< True if we are running an interrupt handler.
+    bool yieldOnReturn;  ///< True if we are to context switch on return
+                         ///< from the interrupt handler.
+    MachineStatus status;  ///< Idle, kernel mode, user mode.
+    bool inKernel;  ///< True if the CPU holds the kernel lock.
+    bool idle;  ///< True while the CPU waits in `Idle` to be woken up.
+};
+
 /// The following class defines the data structures for the simulation
 /// of hardware interrupts.
 ///
@@ -122,6 +144,52 @@ public:
     // Cause a context switch on return from an interrupt handler.
     void YieldOnReturn();
 
+    /// Cause a context switch on every CPU that is running a thread, the
+    /// next time it returns from an interrupt handler.
+    void YieldAllOnReturn();
+
+    /// Give the machine `n` CPUs, at most `MAX_CPUS`.  There is one by
+    /// default.
+    ///
+    /// Each CPU has its own interrupt level and status, and is driven by
+    /// its own host thread, which must call `BootCpu` first.  The caller
+    /// becomes CPU 0.
+    ///
+    /// With more than one CPU, kernel code is serialized by a single
+    /// kernel lock: a CPU holds it whenever it is not running user
+    /// instructions, and only lets it go in `Idle` and `LeaveKernel`.
+    void SetNumCpus(unsigned n);
+    unsigned GetNumCpus() const;
+
+    /// Record the interrupts delivered, or replay them, with `r`, which
+    /// is deleted along with the interrupt simulation.
+    ///
+    /// Must be set up before any device, and with a single CPU.
+    void SetReplay(Replay *r);
+
+    /// The record or replay in course, or null.
+    Replay *GetReplay() const;
+
+    /// Number of the CPU the calling host thread drives.
+    unsigned GetCpu() const;
+
+    /// Make the calling host thread drive CPU `cpu`, and wait for the
+    /// kernel lock.
+    void BootCpu(unsigned cpu);
+
+    /// Take the kernel lock on the way from user code into the kernel.
+    ///
+    /// Returns false if the CPU already held it, in which case the matching
+    /// `LeaveKernel` must be skipped.
+    bool EnterKernel();
+
+    /// Let go of the kernel lock on the way back to user code.
+    void LeaveKernel();
+
+    /// Wake up `cpu` if it is idle, because there is now a thread ready to
+    /// run on it.
+    void WakeCpu(unsigned cpu);
+
     // Idle, kernel, user.
     MachineStatus GetStatus() const;
 
@@ -142,20 +210,64 @@ public:
     void Schedule(VoidFunctionPtr handler, void *arg,
                   unsigned long when, IntType type);
 
-    /// Advance simulated time.
-    void OneTick();
+    /// Advance simulated time, by `userTicks` if a user instruction is
+    /// being run.
+    ///
+    /// Returns true if any interrupt handler was invoked.
+    bool OneTick(unsigned long userTicks = USER_TICK);
+
+    /// Number of user ticks that can pass before any pending interrupt is
+    /// due.
+    ///
+    /// Those ticks need not go through `OneTick` one instruction at a
+    /// time: they can be charged at once with `ChargeUserTicks`.
+    ///
+    /// With more than one CPU, the ticks already given to the other CPUs
+    /// are not taken back when an interrupt is scheduled sooner than the
+    /// one they were computed for.  That interrupt may then be delivered
+    /// late, by up to one CPU's share.
+    unsigned long UserTicksBeforeDue() const;
+
+    /// Advance simulated time by `n` user ticks, without checking for
+    /// interrupts.
+    void ChargeUserTicks(unsigned long n);
+
+    /// Store the type and time of the pending interrupts, soonest first,
+    /// for a checkpoint.
+    ///
+    /// Returns how many there are; only the first `max` are stored.
+    unsigned SavePending(IntType *types, unsigned long *times,
+                         unsigned max);
+
+    /// Move the pending interrupts to the times saved by `SavePending`,
+    /// as simulated time is set back to `now`.
+    ///
+    /// The devices must have scheduled their interrupts anew: each one
+    /// takes the saved time of the next saved interrupt of its type.
+    /// Those left over keep their distance from the current time.
+    void RestorePending(const IntType *types, const unsigned long *times,
+                        unsigned n, unsigned long now);
 
 private:
-    IntStatus level;  ///< Are interrupts enabled or disabled?
-    List<PendingInterrupt *> *pending;  ///< The list of interrupts scheduled
-                                        ///< to occur in the future.
-    bool inHandler;  ///< True if we are running an interrupt handler.
-    bool yieldOnReturn;  ///< True if we are to context switch on return from
-                         ///< the interrupt handler.
-    MachineStatus status;  ///< Idle, kernel mode, user mode.
+    Heap<PendingInterrupt> *pending;  ///< The interrupts scheduled to occur
+                                      ///< in the future, soonest first.
+    unsigned long nextDue;  ///< When the soonest of them is to occur, or
+                            ///< `ULONG_MAX` if there is none.
+    CpuState *cpus;  ///< State of each CPU.
+    Replay *replay;  ///< Log of the interrupts delivered, or null.
+    unsigned numCpus;
+    std::mutex kernelLock;  ///< Held by the CPU running kernel code.
+    std::condition_variable cpuWoken;  ///< Signaled by `WakeCpu`.
 
     /// These functions are internal to the interrupt simulation code.
 
+    /// State of the CPU the calling host thread drives.
+    CpuState &Current() const;
+
+    /// Wait in `Idle` until this CPU is woken up.  Return false at once,
+    /// without waiting, if every other CPU is idle too.
+    bool WaitForWork();
+
     /// Check if an interrupt is supposed to occur now.
     bool CheckIfDue(bool advanceClock);
 
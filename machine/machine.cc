@@ -45,7 +45,14 @@ CheckEndian()
 /// * `st` -- pointer to an object that performs single stepping, for
 ///   dropping into it after each user instruction is executed; if null,
 ///   execute normally, without single stepping.
-Machine::Machine(SingleStepper *st)
+/// * `threaded` -- if true, run user programs with the threaded engine
+///   instead of the reference interpreter.
+/// * `memory` -- main memory of another CPU to share, or null for a machine
+///   with memory of its own.
+/// * `numPhysPages` -- number of frames of main memory.
+Machine::Machine(SingleStepper *st, bool threaded, char *memory,
+                 unsigned numPhysPages)
+    : mmu(memory, numPhysPages)
 {
     for (unsigned i = 0; i < NUM_TOTAL_REGS; i++)
         registers[i] = 0;
@@ -53,7 +60,13 @@ Machine::Machine(SingleStepper *st)
     for (unsigned i = 0; i < NUM_EXCEPTION_TYPES; i++)
         handlers[i] = nullptr;
 
-    singleStepper = st;
+    singleStepper  = st;
+    threadedEngine = threaded;
+    profiler       = nullptr;
+    owedTicks        = 0;
+    tickBudget       = 0;
+    owedInstructions = 0;
+    owedStall        = 0;
     CheckEndian();
 }
 
@@ -69,6 +82,34 @@ Machine::GetMMU()
     return &mmu;
 }
 
+CostModel *
+Machine::GetCostModel()
+{
+    return &costModel;
+}
+
+/// The stall is owed like the ticks of the instruction, so it is charged
+/// at the next interrupt check, which it makes happen right away if it
+/// takes up the rest of the budget.
+void
+Machine::Stall(unsigned long ticks)
+{
+    owedTicks += ticks;
+    owedStall += ticks;
+}
+
+void
+Machine::SetProfiler(Profiler *p)
+{
+    profiler = p;
+}
+
+Profiler *
+Machine::GetProfiler()
+{
+    return profiler;
+}
+
 /// Fetch or write the contents of a user program register.
 int
 Machine::ReadRegister(unsigned num) const
@@ -110,6 +151,74 @@ Machine::WriteMem(unsigned addr, unsigned size, int value)
     return true;
 }
 
+/// Let the kernel handle a fault of a block copy at `addr`.
+///
+/// Return false if the last fault was at the same address, so handling it
+/// did not help.
+bool
+Machine::HandleBlockFault(ExceptionType e, unsigned addr, unsigned *lastFault)
+{
+    if (addr == *lastFault)
+        return false;
+    *lastFault = addr;
+    RaiseException(e, addr);
+    return true;
+}
+
+bool
+Machine::ReadBlock(unsigned addr, char *buffer, unsigned size)
+{
+    unsigned lastFault = addr - 1;
+    unsigned done = 0;
+    for (;;) {
+        unsigned n;
+        ExceptionType e = mmu.ReadBlock(addr + done, buffer + done,
+                                        size - done, &n);
+        done += n;
+        if (e == NO_EXCEPTION)
+            return true;
+        if (!HandleBlockFault(e, addr + done, &lastFault))
+            return false;
+    }
+}
+
+bool
+Machine::WriteBlock(unsigned addr, const char *buffer, unsigned size)
+{
+    unsigned lastFault = addr - 1;
+    unsigned done = 0;
+    for (;;) {
+        unsigned n;
+        ExceptionType e = mmu.WriteBlock(addr + done, buffer + done,
+                                         size - done, &n);
+        done += n;
+        if (e == NO_EXCEPTION)
+            return true;
+        if (!HandleBlockFault(e, addr + done, &lastFault))
+            return false;
+    }
+}
+
+bool
+Machine::ReadString(unsigned addr, char *buffer, unsigned maxSize,
+                    unsigned *length)
+{
+    ASSERT(length != nullptr);
+
+    unsigned lastFault = addr - 1;
+    *length = 0;
+    for (;;) {
+        unsigned n;
+        ExceptionType e = mmu.ReadString(addr + *length, buffer + *length,
+                                         maxSize - *length, &n);
+        *length += n;
+        if (e == NO_EXCEPTION)
+            return true;
+        if (!HandleBlockFault(e, addr + *length, &lastFault))
+            return false;
+    }
+}
+
 /// Transfer control to the Nachos kernel from user mode, because the user
 /// program either invoked a system call, or some exception occured (such as
 /// the address translation failed).
@@ -125,6 +234,8 @@ Machine::RaiseException(ExceptionType et, unsigned badVAddr)
     DEBUG('m', "Exception: %s\n", ExceptionTypeToString(et));
 
     //ASSERT(interrupt->GetStatus() == USER_MODE);
+    bool entered = interrupt->EnterKernel();
+    FlushTicks();  // The kernel must see the right time.
     registers[BAD_VADDR_REG] = badVAddr;
     DelayedLoad(0, 0);  // Finish anything in progress.
 
@@ -132,6 +243,8 @@ Machine::RaiseException(ExceptionType et, unsigned badVAddr)
     interrupt->SetStatus(SYSTEM_MODE);
     (*handlers[et])(et);
     interrupt->SetStatus(USER_MODE);
+    if (entered)
+        interrupt->LeaveKernel();
 }
 
 void
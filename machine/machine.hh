@@ -21,11 +21,15 @@
 #define NACHOS_MACHINE_MACHINE__HH
 
 
+#include "cost_model.hh"
 #include "exception_type.hh"
 #include "mmu.hh"
+#include "profiler.hh"
 #include "single_stepper.hh"
 #include "lib/utility.hh"
 
+#include <stdint.h>
+
 
 // User program CPU state.  The full set of MIPS registers, plus a few
 // more because we need to be able to start/stop a user program between
@@ -67,8 +71,10 @@ typedef void (*ExceptionHandler)(ExceptionType);
 class Machine {
 public:
 
-    /// Initialize the simulation of the hardware for running user programs.
-    Machine(SingleStepper *st);
+    /// Initialize the simulation of the hardware for running user programs,
+    /// with `numPhysPages` frames of main memory.
+    Machine(SingleStepper *st, bool threaded, char *memory,
+            unsigned numPhysPages);
 
     /// Routines callable by the Nachos kernel.
 
@@ -79,6 +85,20 @@ public:
 
     MMU *GetMMU();
 
+    /// Ticks taken by user instructions and stalls; the kernel may change
+    /// them before running user programs.
+    CostModel *GetCostModel();
+
+    /// Make the instruction being run stall for `ticks` more.
+    ///
+    /// Called by the MMU on TLB refills, and by the kernel on page faults.
+    void Stall(unsigned long ticks);
+
+    /// Profile the user programs run with `p`, or stop if it is null.
+    void SetProfiler(Profiler *p);
+
+    Profiler *GetProfiler();
+
     /// Read the contents of a CPU register.
     int ReadRegister(unsigned num) const;
 
@@ -92,6 +112,21 @@ public:
 
     bool WriteMem(unsigned addr, unsigned size, int value);
 
+    /// Copy blocks of user memory, a page at a time.
+    ///
+    /// Faults are raised as they happen, and the copy goes on from the
+    /// faulting address once the kernel handled them.  Return false if the
+    /// same address faults twice in a row.
+
+    bool ReadBlock(unsigned addr, char *buffer, unsigned size);
+
+    bool WriteBlock(unsigned addr, const char *buffer, unsigned size);
+
+    /// Copy a null-terminated string of at most `maxSize` bytes; store
+    /// the number of bytes copied, null included, in `*length`.
+    bool ReadString(unsigned addr, char *buffer, unsigned maxSize,
+                    unsigned *length);
+
     /// Print the user CPU and memory state.
     void DumpState();
 
@@ -99,15 +134,38 @@ public:
 
     /// Fetch one instruction of a user program.
     ///
+    /// The decoded instruction is taken from the MMU's decode cache, so
+    /// `*instr` must not be kept across memory writes.
+    ///
     /// Return false if an exception occurs, true otherwise.
-    bool FetchInstruction(Instruction *instr);
+    bool FetchInstruction(const Instruction **instr);
 
     /// Run a certain instruction of a user program.
-    void ExecInstruction(const Instruction *instr);
+    ///
+    /// Return false if it raised an exception instead of completing.
+    bool ExecInstruction(const Instruction *instr);
+
+    /// Run a user program with the threaded engine (see `threaded_sim.cc`).
+    ///
+    /// Never returns.
+    void RunThreaded();
 
     /// Do a pending delayed load (modifying a reg).
     void DelayedLoad(unsigned nextReg, int nextVal);
 
+    /// Account for the simulated time of the instruction just run, which
+    /// took `ticks`, and count it if it was `retired`.  An attempt aborted
+    /// by an exception takes `USER_TICK`, whatever the instruction.
+    ///
+    /// Ticks are only owed while no interrupt can be due; otherwise this
+    /// is the same as `Interrupt::OneTick`.  Returns true if an interrupt
+    /// handler was invoked.
+    bool Tick(unsigned long ticks, bool retired);
+
+    /// Charge the owed ticks, if any, and stop owing new ones until the
+    /// next interrupt check.
+    void FlushTicks();
+
     /// Trap to the Nachos kernel, because of a system call or other
     /// exception.
     void RaiseException(ExceptionType et, unsigned badVAddr);
@@ -125,6 +183,30 @@ private:
                                    ///< provided object (may be a debugger)
                                    ///< after each simulated instruction.
 
+    bool threadedEngine;  ///< Run basic blocks through the instruction
+                          ///< handlers instead of `ExecInstruction`.
+
+    Profiler *profiler;  ///< Counts the instructions run, if profiling.
+
+    CostModel costModel;  ///< Ticks taken by user instructions and stalls.
+
+    unsigned long owedTicks;   ///< User ticks passed but not yet charged.
+    unsigned long tickBudget;  ///< How many ticks can be owed before the
+                               ///< next interrupt check.
+    unsigned long owedInstructions;  ///< User instructions run but not yet
+                                     ///< counted in the statistics.
+    unsigned long owedStall;   ///< Part of `owedTicks` spent stalled.
+
+    /// Charge the owed ticks and the `ticks` of the current instruction
+    /// through `OneTick`, then find out how many of the following ones can
+    /// be owed.
+    bool CheckInterrupts(unsigned long ticks);
+
+    /// Raise a fault of a block copy at `addr`, unless `*lastFault` says it
+    /// already failed there; see `ReadBlock`.
+    bool HandleBlockFault(ExceptionType e, unsigned addr,
+                          unsigned *lastFault);
+
     /// Private data structures.
     int registers[NUM_TOTAL_REGS];  ///< CPU registers, for executing user
                                     ///< programs.
@@ -134,5 +216,64 @@ private:
     ExceptionHandler handlers[NUM_EXCEPTION_TYPES];  ///< Exception handlers.
 };
 
+inline bool
+Machine::Tick(unsigned long ticks, bool retired)
+{
+    owedInstructions += retired;
+    if (owedTicks + ticks <= tickBudget) {
+        owedTicks += ticks;
+        return false;
+    }
+    return CheckInterrupts(ticks);
+}
+
+// R2000 arithmetic, shared by both execution engines.  The host does it
+// in 64 bits, or tells overflow by itself.
+
+/// Multiply `a` by `b`, leaving the double-length product in `*hiPtr` and
+/// `*loPtr`.
+static inline void
+Mult(int a, int b, bool signedArith, int *hiPtr, int *loPtr)
+{
+    uint64_t product = signedArith
+      ? (uint64_t) ((int64_t) a * (int64_t) b)
+      : (uint64_t) (unsigned) a * (unsigned) b;
+    *hiPtr = (int) (product >> 32);
+    *loPtr = (int) product;
+}
+
+/// Divide `a` by `b`, leaving the quotient in `*loPtr` and the remainder in
+/// `*hiPtr`.
+///
+/// Division by zero leaves zeros in both.  The quotient of the most
+/// negative number by -1 wraps around, rather than trapping on the host.
+static inline void
+Div(int a, int b, bool signedArith, int *hiPtr, int *loPtr)
+{
+    if (b == 0) {
+        *loPtr = *hiPtr = 0;
+    } else if (signedArith) {
+        *loPtr = (int) ((int64_t) a / b);
+        *hiPtr = (int) ((int64_t) a % b);
+    } else {
+        *loPtr = (int) ((unsigned) a / (unsigned) b);
+        *hiPtr = (int) ((unsigned) a % (unsigned) b);
+    }
+}
+
+/// Store `a + b` in `*sum`; return true if it overflowed.
+static inline bool
+AddOverflows(int a, int b, int *sum)
+{
+    return __builtin_add_overflow(a, b, sum);
+}
+
+/// Store `a - b` in `*diff`; return true if it overflowed.
+static inline bool
+SubOverflows(int a, int b, int *diff)
+{
+    return __builtin_sub_overflow(a, b, diff);
+}
+
 
 #endif
@@ -0,0 +1,47 @@
+/// Copyright (c) 2016-2020 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+
+#include "mem_trace.hh"
+#include "threads/system.hh"
+
+
+MemTrace::MemTrace(const char *fileName, const int *pc_)
+{
+    ASSERT(fileName != nullptr);
+    ASSERT(pc_ != nullptr);
+
+    file  = SystemDep::OpenForWrite(fileName);
+    pc    = pc_;
+    space = 0;
+    used  = 0;
+
+    memTraceHeader h;
+    h.magic      = MEM_TRACE_MAGIC;
+    h.version    = MEM_TRACE_VERSION;
+    h.recordSize = sizeof (memTraceRecord);
+    h.pageSize   = PAGE_SIZE;
+    SystemDep::WriteFile(file, (const char *) &h, sizeof h);
+}
+
+MemTrace::~MemTrace()
+{
+    Flush();
+    SystemDep::Close(file);
+}
+
+void
+MemTrace::SetSpace(unsigned space_)
+{
+    space = space_;
+}
+
+void
+MemTrace::Flush()
+{
+    if (used == 0)
+        return;
+    SystemDep::WriteFile(file, (const char *) buffer, used * sizeof *buffer);
+    used = 0;
+}
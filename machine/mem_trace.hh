@@ -0,0 +1,68 @@
+/// Writer of memory reference traces.
+///
+/// The MMU hands every user memory reference to a `MemTrace`, which stores
+/// it in binary (see `bin/mem_trace.h`) in a buffer of fixed size, written
+/// out whenever it fills up.  `bin/readtrace` decodes the result.
+///
+/// Copyright (c) 2016-2020 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+#ifndef NACHOS_MACHINE_MEMTRACE__HH
+#define NACHOS_MACHINE_MEMTRACE__HH
+
+
+#include "bin/mem_trace.h"
+
+
+/// Number of references buffered before writing them.
+const unsigned MEM_TRACE_BUFFER_SIZE = 4096;
+
+class MemTrace {
+public:
+
+    /// Start a trace in host file `fileName`, taking the address of each
+    /// referencing instruction from `*pc`.
+    MemTrace(const char *fileName, const int *pc);
+
+    /// Write out the references still buffered, and close the file.
+    ~MemTrace();
+
+    /// Attribute the references made from now on to address space
+    /// `space`.
+    void SetSpace(unsigned space);
+
+    /// Record a reference of `size` bytes to `virtualAddr`, translated to
+    /// `physicalAddr`.
+    void Record(unsigned virtualAddr, unsigned physicalAddr, unsigned size,
+                bool writing);
+
+    /// Write out the references buffered.
+    void Flush();
+
+private:
+    int file;
+    const int *pc;
+    unsigned space;
+
+    memTraceRecord buffer[MEM_TRACE_BUFFER_SIZE];
+    unsigned used;  ///< Number of references in `buffer`.
+};
+
+inline void
+MemTrace::Record(unsigned virtualAddr, unsigned physicalAddr, unsigned size,
+                 bool writing)
+{
+    memTraceRecord *r = &buffer[used];
+    r->pc           = *pc;
+    r->virtualAddr  = virtualAddr;
+    r->physicalAddr = physicalAddr;
+    r->space        = space;
+    r->size         = size;
+    r->flags        = writing ? MEM_TRACE_WRITE : 0;
+    if (++used == MEM_TRACE_BUFFER_SIZE)
+        Flush();
+}
+
+
+#endif
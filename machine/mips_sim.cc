@@ -27,17 +27,31 @@
 void
 Machine::Run()
 {
-    Instruction *instr = new Instruction;
-      // Storage for decoded instruction.
+    const Instruction *instr;  // Decoded instruction, owned by the MMU.
 
     if (debug.IsEnabled('m'))
         printf("Starting to run at time %lu\n", stats->totalTicks);
     interrupt->SetStatus(USER_MODE);
+    interrupt->LeaveKernel();
+
+    // Single stepping and instruction tracing need to see every
+    // instruction go through `FetchInstruction`.
+    if (threadedEngine && singleStepper == nullptr
+          && !debug.IsEnabled('m'))
+        RunThreaded();
 
     for (;;) {
-        if (FetchInstruction(instr))
-            ExecInstruction(instr);
-        interrupt->OneTick();
+        unsigned long ticks = USER_TICK;  // An aborted attempt takes a tick.
+        bool retired = false;
+        if (FetchInstruction(&instr)) {
+            if (profiler != nullptr)
+                profiler->Count(registers[PC_REG], instr);
+            unsigned long cost = costModel.instruction[instr->opCode];
+            retired = ExecInstruction(instr);
+            if (retired)
+                ticks = cost;
+        }
+        Tick(ticks, retired);
         if (singleStepper != nullptr && !singleStepper->Step())
             singleStepper = nullptr;
     }
@@ -57,17 +71,18 @@ Machine::DelayedLoad(unsigned nextReg, int nextValue)
 }
 
 bool
-Machine::FetchInstruction(Instruction *instr)
+Machine::FetchInstruction(const Instruction **instrPtr)
 {
-    ASSERT(instr != nullptr);
+    ASSERT(instrPtr != nullptr);
 
-    int raw;
-    if (!ReadMem(registers[PC_REG], 4, &raw))
+    ExceptionType e = mmu.FetchInstruction(registers[PC_REG], instrPtr);
+    if (e != NO_EXCEPTION) {
+        RaiseException(e, registers[PC_REG]);
         return false;  // Exception occurred.
-    instr->value = raw;
-    instr->Decode();
+    }
 
     if (debug.IsEnabled('m')) {
+        const Instruction *instr = *instrPtr;
         const struct OpString *str = &OP_STRINGS[instr->opCode];
 
         ASSERT(instr->opCode <= MAX_OPCODE);
@@ -80,70 +95,40 @@ Machine::FetchInstruction(Instruction *instr)
     return true;
 }
 
-/// Simulate R2000 multiplication.
-///
-/// The words at `*hiPtr` and `*loPtr` are overwritten with the double-length
-/// result of the multiplication.
-static void
-Mult(int a, int b, bool signedArith, int *hiPtr, int *loPtr)
+/// Charge the ticks owed by the instructions run since the last interrupt
+/// check, and account the cache events they caused.
+void
+Machine::FlushTicks()
 {
-    ASSERT(hiPtr != nullptr);
-    ASSERT(loPtr != nullptr);
-
-    if (a == 0 || b == 0) {
-        *hiPtr = *loPtr = 0;
-        return;
-    }
-
-    // Compute the sign of the result, then make everything positive so
-    // unsigned computation can be done in the main loop.
-    bool negative = false;
-    if (signedArith) {
-        if (a < 0) {
-            negative = !negative;
-            a = -a;
-        }
-        if (b < 0) {
-            negative = !negative;
-            b = -b;
-        }
-    }
-
-    // Compute the result in unsigned arithmetic (check `a`'s bits one at a
-    // time, and add in a shifted value of `b`).
-    unsigned bLo = b;
-    unsigned bHi = 0;
-    unsigned lo = 0;
-    unsigned hi = 0;
-    for (unsigned i = 0; i < 32; i++) {
-        if (a & 1) {
-            lo += bLo;
-            if (lo < bLo)  // Carry out of the low bits?
-                hi += 1;
-            hi += bHi;
-            if ((a & 0xFFFFFFFE) == 0)
-                break;
-        }
-        bHi <<= 1;
-        if (bLo & 0x80000000)
-            bHi |= 1;
-
-        bLo <<= 1;
-        a >>= 1;
-    }
-
-    // If the result is supposed to be negative, compute the two's complement
-    // of the double-word result.
-    if (negative) {
-        hi = ~hi;
-        lo = ~lo;
-        lo++;
-        if (lo == 0)
-            hi++;
-    }
+    interrupt->ChargeUserTicks(owedTicks);
+    stats->userInstructions += owedInstructions;
+    stats->stallTicks       += owedStall;
+    mmu.FlushCacheStats();
+    owedTicks        = 0;
+    tickBudget       = 0;
+    owedInstructions = 0;
+    owedStall        = 0;
+}
 
-    *hiPtr = (int) hi;
-    *loPtr = (int) lo;
+/// Advance simulated time for the current instruction, firing any interrupt
+/// that is due, as `Run` used to do after every instruction.
+///
+/// Then, unless single stepping, compute how many ticks can pass before the
+/// next interrupt is due: the ticks of the instructions run meanwhile are
+/// just counted by `Tick`, and charged in bulk at the next check or
+/// exception.  Timing is the same as ticking after every instruction.
+///
+/// With more than one CPU, the kernel lock is held while checking.
+bool
+Machine::CheckInterrupts(unsigned long ticks)
+{
+    interrupt->EnterKernel();
+    FlushTicks();
+    bool fired = interrupt->OneTick(ticks);
+    if (singleStepper == nullptr)
+        tickBudget = interrupt->UserTicksBeforeDue();
+    interrupt->LeaveKernel();
+    return fired;
 }
 
 /// Execute one instruction from a user-level program.
@@ -163,7 +148,7 @@ Mult(int a, int b, bool signedArith, int *hiPtr, int *loPtr)
 /// all data back to the machine registers and memory before leaving.  This
 /// allows the Nachos kernel to control our behavior by controlling the
 /// contents of memory, the translation table, and the register set.
-void
+bool
 Machine::ExecInstruction(const Instruction *instr)
 {
     int nextLoadReg = 0;
@@ -180,21 +165,18 @@ Machine::ExecInstruction(const Instruction *instr)
     switch (instr->opCode) {
 
         case OP_ADD:
-            sum = registers[instr->rs] + registers[instr->rt];
-            if (!((registers[instr->rs] ^ registers[instr->rt]) & SIGN_BIT)
-                  && (registers[instr->rs] ^ sum) & SIGN_BIT) {
+            if (AddOverflows(registers[instr->rs], registers[instr->rt],
+                             &sum)) {
                 RaiseException(OVERFLOW_EXCEPTION, 0);
-                return;
+                return false;
             }
             registers[instr->rd] = sum;
             break;
 
         case OP_ADDI:
-            sum = registers[instr->rs] + instr->extra;
-            if (!((registers[instr->rs] ^ instr->extra) & SIGN_BIT)
-                  && (instr->extra ^ sum) & SIGN_BIT) {
+            if (AddOverflows(registers[instr->rs], instr->extra, &sum)) {
                 RaiseException(OVERFLOW_EXCEPTION, 0);
-                return;
+                return false;
             }
             registers[instr->rt] = sum;
             break;
@@ -253,29 +235,13 @@ Machine::ExecInstruction(const Instruction *instr)
             break;
 
         case OP_DIV:
-            if (registers[instr->rt] == 0) {
-                registers[LO_REG] = 0;
-                registers[HI_REG] = 0;
-            } else {
-                registers[LO_REG] = registers[instr->rs]
-                                    / registers[instr->rt];
-                registers[HI_REG] = registers[instr->rs]
-                                    % registers[instr->rt];
-            }
+            Div(registers[instr->rs], registers[instr->rt],
+                true, &registers[HI_REG], &registers[LO_REG]);
             break;
 
         case OP_DIVU:
-            rs = (unsigned) registers[instr->rs];
-            rt = (unsigned) registers[instr->rt];
-            if (rt == 0) {
-                registers[LO_REG] = 0;
-                registers[HI_REG] = 0;
-            } else {
-                tmp = rs / rt;
-                registers[LO_REG] = (int) tmp;
-                tmp = rs % rt;
-                registers[HI_REG] = (int) tmp;
-            }
+            Div(registers[instr->rs], registers[instr->rt],
+                false, &registers[HI_REG], &registers[LO_REG]);
             break;
 
         case OP_JAL:
@@ -294,7 +260,7 @@ Machine::ExecInstruction(const Instruction *instr)
         case OP_LBU:
             tmp = registers[instr->rs] + instr->extra;
             if (!ReadMem(tmp, 1, &value))
-                return;
+                return false;
 
             if (value & 0x80 && instr->opCode == OP_LB)
                 value |= 0xFFFFFF00;
@@ -309,10 +275,10 @@ Machine::ExecInstruction(const Instruction *instr)
             tmp = registers[instr->rs] + instr->extra;
             if (tmp & 0x1) {
                 RaiseException(ADDRESS_ERROR_EXCEPTION, tmp);
-                return;
+                return false;
             }
             if (!ReadMem(tmp, 2, &value))
-                return;
+                return false;
 
             if (value & 0x8000 && instr->opCode == OP_LH)
                 value |= 0xFFFF0000;
@@ -331,10 +297,10 @@ Machine::ExecInstruction(const Instruction *instr)
             tmp = registers[instr->rs] + instr->extra;
             if (tmp & 0x3) {
                 RaiseException(ADDRESS_ERROR_EXCEPTION, tmp);
-                return;
+                return false;
             }
             if (!ReadMem(tmp, 4, &value))
-                return;
+                return false;
             nextLoadReg = instr->rt;
             nextLoadValue = value;
             break;
@@ -348,7 +314,7 @@ Machine::ExecInstruction(const Instruction *instr)
             ASSERT((tmp & 0x3) == 0);
 
             if (!ReadMem(tmp, 4, &value))
-                return;
+                return false;
             if (registers[LOAD_REG] == instr->rt)
                 nextLoadValue = registers[LOAD_VALUE_REG];
             else
@@ -379,7 +345,7 @@ Machine::ExecInstruction(const Instruction *instr)
             ASSERT((tmp & 0x3) == 0);
 
             if (!ReadMem(tmp, 4, &value))
-                return;
+                return false;
             if (registers[LOAD_REG] == instr->rt)
                 nextLoadValue = registers[LOAD_VALUE_REG];
             else
@@ -448,13 +414,13 @@ Machine::ExecInstruction(const Instruction *instr)
         case OP_SB:
             if (!WriteMem((unsigned) (registers[instr->rs] + instr->extra),
                           1, registers[instr->rt]))
-                return;
+                return false;
             break;
 
         case OP_SH:
             if (!WriteMem((unsigned) (registers[instr->rs] + instr->extra),
                           2, registers[instr->rt]))
-                return;
+                return false;
             break;
 
         case OP_SLL:
@@ -520,11 +486,10 @@ Machine::ExecInstruction(const Instruction *instr)
             break;
 
         case OP_SUB:
-            diff = registers[instr->rs] - registers[instr->rt];
-            if ((registers[instr->rs] ^ registers[instr->rt]) & SIGN_BIT
-                  && (registers[instr->rs] ^ diff) & SIGN_BIT) {
+            if (SubOverflows(registers[instr->rs], registers[instr->rt],
+                             &diff)) {
                 RaiseException(OVERFLOW_EXCEPTION, 0);
-                return;
+                return false;
             }
             registers[instr->rd] = diff;
             break;
@@ -537,7 +502,7 @@ Machine::ExecInstruction(const Instruction *instr)
         case OP_SW:
             if (!WriteMem((unsigned) (registers[instr->rs] + instr->extra),
                           4, registers[instr->rt]))
-                return;
+                return false;
             break;
 
         case OP_SWL:
@@ -548,7 +513,7 @@ Machine::ExecInstruction(const Instruction *instr)
             ASSERT((tmp & 0x3) == 0);
 
             if (!ReadMem(tmp & ~0x3, 4, &value))
-                return;
+                return false;
             switch (tmp & 0x3) {
                 case 0:
                     value = registers[instr->rt];
@@ -567,7 +532,7 @@ Machine::ExecInstruction(const Instruction *instr)
                     break;
             }
             if (!WriteMem(tmp & ~0x3, 4, value))
-                return;
+                return false;
             break;
 
         case OP_SWR:
@@ -578,7 +543,7 @@ Machine::ExecInstruction(const Instruction *instr)
             ASSERT((tmp & 0x3) == 0);
 
             if (!ReadMem(tmp & ~0x3, 4, &value))
-                return;
+                return false;
             switch (tmp & 0x3) {
                 case 0:
                     value = (value & 0xFFFFFF)
@@ -596,12 +561,12 @@ Machine::ExecInstruction(const Instruction *instr)
                     break;
             }
             if (!WriteMem(tmp & ~0x3, 4, value))
-                return;
+                return false;
             break;
 
         case OP_SYSCALL:
             RaiseException(SYSCALL_EXCEPTION, 0);
-            return;
+            return false;
 
         case OP_XOR:
             registers[instr->rd] = registers[instr->rs]
@@ -616,7 +581,7 @@ Machine::ExecInstruction(const Instruction *instr)
         case OP_RES:
         case OP_UNIMP:
             RaiseException(ILLEGAL_INSTR_EXCEPTION, 0);
-            return;
+            return false;
 
         default:
             ASSERT(false);
@@ -632,4 +597,5 @@ Machine::ExecInstruction(const Instruction *instr)
       // For debugging, in case we are jumping into lala-land.
     registers[PC_REG] = registers[NEXT_PC_REG];
     registers[NEXT_PC_REG] = pcAfter;
+    return true;
 }
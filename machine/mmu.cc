@@ -18,7 +18,13 @@
 /// the hardware does not need to know anything at all about that.
 ///
 /// Note that the contents of the TLB are specific to an address space.
-/// If the address space changes, so does the contents of the TLB!
+/// If the address space changes, so does the contents of the TLB!  Entries
+/// are tagged with an address space identifier, so the kernel can switch
+/// identifiers instead of flushing the TLB.
+///
+/// The TLB can optionally be backed by a hardware page table walker: on a
+/// miss, the MMU looks the page up in the linear page table itself, and
+/// only traps to the kernel if it cannot find a valid mapping there.
 ///
 /// DO NOT CHANGE -- part of the machine emulation
 ///
@@ -30,31 +36,92 @@
 
 #include "mmu.hh"
 #include "endianness.hh"
-//#include "threads/system.hh"
-//#include "lib/utility.hh"
+#include "threads/system.hh"
 
-MMU::MMU()
-{
-    mainMemory = new char [MEMORY_SIZE];
-    for (unsigned i = 0; i < MEMORY_SIZE; i++)
-          mainMemory[i] = 0;
+#include <string.h>
 
+/// Main memory is mapped from the host zero-filled, so its frames only take
+/// up host memory once used.
+MMU::MMU(char *memory, unsigned numPhysPages_)
+    : decodeCache(numPhysPages_, PAGE_SIZE)
+{
+    ASSERT(numPhysPages_ > 0
+           && numPhysPages_ <= MAX_MEMORY_SIZE / PAGE_SIZE);
+
+    numPhysPages = numPhysPages_;
+    sharedMemory = memory != nullptr;
+    if (sharedMemory)
+        mainMemory = memory;
+    else
+        mainMemory = (char *) SystemDep::MapZeroed(numPhysPages * PAGE_SIZE);
+    staleFrames   = (bool *) SystemDep::MapZeroed(
+                      numPhysPages * sizeof *staleFrames);
+    anyStaleFrame = false;
+
+    tlb           = nullptr;
+    tlbNext       = nullptr;
+    tlbReferenced = nullptr;
+    tlbAge        = nullptr;
+    tlbSize       = 0;
+    tlbPolicy     = TLB_FIFO;
+    tlbPrefetch   = false;
+    pinnedCode    = (unsigned) -1;
+    pinnedData    = (unsigned) -1;
+    currentAsid   = 0;
+    tlbWalker     = false;
+    trace         = nullptr;
+    instrCache    = nullptr;
+    dataCache     = nullptr;
+    iCacheHits    = 0;
+    iCacheMisses  = 0;
+    dCacheHits    = 0;
+    dCacheMisses  = 0;
+    memoryWrites  = 0;
 #ifdef USE_TLB
-    tlb = new TranslationEntry[TLB_SIZE];
-    for (unsigned i = 0; i < TLB_SIZE; i++)
-        tlb[i].valid = false;
-    pageTable = nullptr;
-#else  // Use linear page table.
-    tlb = nullptr;
-    pageTable = nullptr;
+    ConfigureTlb(TLB_SIZE, TLB_SIZE);
 #endif
+    pageTable = nullptr;
+
+    FlushSoftTlb();
 }
 
 MMU::~MMU()
 {
-    delete [] mainMemory;
+    if (!sharedMemory)
+        SystemDep::Unmap(mainMemory, numPhysPages * PAGE_SIZE);
+    SystemDep::Unmap(staleFrames, numPhysPages * sizeof *staleFrames);
     if (tlb != nullptr)
         delete [] tlb;
+    delete [] tlbNext;
+    delete [] tlbReferenced;
+    delete [] tlbAge;
+    delete instrCache;
+    delete dataCache;
+}
+
+/// Look a virtual address up in the soft TLB.
+///
+/// Returns the host address of the data, or null if there is no mapping for
+/// the page with the needed permission, or the address is misaligned.
+inline char *
+MMU::SoftTranslate(unsigned virtAddr, unsigned size, bool writing)
+{
+    if (virtAddr & (size - 1))
+        return nullptr;  // Let `Translate` report the alignment error.
+
+    unsigned vpn = virtAddr / PAGE_SIZE;
+    const SoftTlbEntry *entry = &softTlb[vpn % SOFT_TLB_SIZE];
+    if (entry->virtualPage != vpn)
+        return nullptr;
+
+    char *base = writing ? entry->writeBase : entry->readBase;
+    if (base == nullptr)
+        return nullptr;
+
+    // The mapping came from the TLB, which would have hit as well.
+    if (tlb != nullptr)
+        stats->numTlbHits++;
+    return base + virtAddr % PAGE_SIZE;
 }
 
 /// Read `size` (1, 2, or 4) bytes of virtual memory at `addr` into
@@ -72,25 +139,36 @@ MMU::ReadMem(unsigned addr, unsigned size, int *value)
     ASSERT(value != nullptr); 
     DEBUG('a', "Reading VA 0x%X, size %u\n", addr, size);
 
-    unsigned physicalAddress;
-    ExceptionType e = Translate(addr, &physicalAddress, size, false);
-    if (e != NO_EXCEPTION)
-        return e;
+    pinnedData = addr / PAGE_SIZE;
+
+    const char *host = SoftTranslate(addr, size, false);
+    if (host == nullptr) {
+        unsigned physicalAddress;
+        ExceptionType e = Translate(addr, &physicalAddress, size, false);
+        if (e != NO_EXCEPTION)
+            return e;
+        host = &mainMemory[physicalAddress];
+    }
+    if (trace != nullptr)
+        trace->Record(addr, host - mainMemory, size, false);
+    if (dataCache != nullptr)
+        AccessCache(dataCache, host - mainMemory, false,
+                    &dCacheHits, &dCacheMisses);
 
     int data;
     switch (size) {
         case 1:
-            data = mainMemory[physicalAddress];
+            data = *host;
             *value = data;
             break;
 
         case 2:
-            data = *(unsigned short *) &mainMemory[physicalAddress];
+            data = *(const unsigned short *) host;
             *value = ShortToHost(data);
             break;
 
         case 4:
-            data = *(unsigned *) &mainMemory[physicalAddress];
+            data = *(const unsigned *) host;
             *value = WordToHost(data);
             break;
 
@@ -116,25 +194,36 @@ MMU::WriteMem(unsigned addr, unsigned size, int value)
 {
     DEBUG('a', "Writing VA 0x%X, size %u, value 0x%X\n", addr, size, value);
 
-    unsigned physicalAddress;
-    ExceptionType e = Translate(addr, &physicalAddress, size, true);
-    if (e != NO_EXCEPTION)
-        return e;
+    pinnedData = addr / PAGE_SIZE;
+
+    char *host = SoftTranslate(addr, size, true);
+    if (host == nullptr) {
+        unsigned physicalAddress;
+        ExceptionType e = Translate(addr, &physicalAddress, size, true);
+        if (e != NO_EXCEPTION)
+            return e;
+        host = &mainMemory[physicalAddress];
+    }
+    if (trace != nullptr)
+        trace->Record(addr, host - mainMemory, size, true);
+    if (dataCache != nullptr)
+        AccessCache(dataCache, host - mainMemory, true,
+                    &dCacheHits, &dCacheMisses);
+
+    decodeCache.NoteWrite(host - mainMemory);
 
     switch (size) {
         case 1:
-            mainMemory[physicalAddress]
-              = (unsigned char) (value & 0xFF);
+            *host = (unsigned char) (value & 0xFF);
             break;
 
         case 2:
-            *(unsigned short *) &mainMemory[physicalAddress]
+            *(unsigned short *) host
               = ShortToMachine((unsigned short) (value & 0xFFFF));
             break;
 
         case 4:
-            *(unsigned *) &mainMemory[physicalAddress]
-              = WordToMachine((unsigned) value);
+            *(unsigned *) host = WordToMachine((unsigned) value);
             break;
 
         default:
@@ -144,8 +233,512 @@ MMU::WriteMem(unsigned addr, unsigned size, int value)
     return NO_EXCEPTION;
 }
 
+inline ExceptionType
+MMU::TranslateBlock(unsigned addr, bool writing, char **host)
+{
+    pinnedData = addr / PAGE_SIZE;
+
+    *host = SoftTranslate(addr, 1, writing);
+    if (*host == nullptr) {
+        unsigned physicalAddress;
+        ExceptionType e = Translate(addr, &physicalAddress, 1, writing);
+        if (e != NO_EXCEPTION)
+            return e;
+        *host = &mainMemory[physicalAddress];
+    }
+    return NO_EXCEPTION;
+}
+
+/// Read `size` bytes of virtual memory at `addr` into `buffer`, a page at a
+/// time.
+///
+/// * `addr` is the virtual address to read from.
+/// * `buffer` is the place to copy the data to.
+/// * `size` is the number of bytes to read.
+/// * `done` is the place to store the number of bytes read.
+ExceptionType
+MMU::ReadBlock(unsigned addr, char *buffer, unsigned size, unsigned *done)
+{
+    ASSERT(buffer != nullptr);
+    ASSERT(done != nullptr);
+    DEBUG('a', "Reading block at VA 0x%X, size %u\n", addr, size);
+
+    *done = 0;
+    while (*done < size) {
+        char *host;
+        ExceptionType e = TranslateBlock(addr + *done, false, &host);
+        if (e != NO_EXCEPTION)
+            return e;
+
+        unsigned n = PAGE_SIZE - (addr + *done) % PAGE_SIZE;
+        if (n > size - *done)
+            n = size - *done;
+        memcpy(buffer + *done, host, n);
+        *done += n;
+    }
+    return NO_EXCEPTION;
+}
+
+/// Write `size` bytes from `buffer` into virtual memory at `addr`, a page at
+/// a time.
+///
+/// * `addr` is the virtual address to write to.
+/// * `buffer` is the data to be written.
+/// * `size` is the number of bytes to write.
+/// * `done` is the place to store the number of bytes written.
+ExceptionType
+MMU::WriteBlock(unsigned addr, const char *buffer, unsigned size,
+                unsigned *done)
+{
+    ASSERT(buffer != nullptr);
+    ASSERT(done != nullptr);
+    DEBUG('a', "Writing block at VA 0x%X, size %u\n", addr, size);
+
+    *done = 0;
+    while (*done < size) {
+        char *host;
+        ExceptionType e = TranslateBlock(addr + *done, true, &host);
+        if (e != NO_EXCEPTION)
+            return e;
+
+        unsigned n = PAGE_SIZE - (addr + *done) % PAGE_SIZE;
+        if (n > size - *done)
+            n = size - *done;
+        decodeCache.NoteWrite(host - mainMemory);
+        memcpy(host, buffer + *done, n);
+        *done += n;
+    }
+    return NO_EXCEPTION;
+}
+
+/// Read a null-terminated string of at most `maxSize` bytes, counting the
+/// null character, from virtual memory at `addr` into `buffer`.
+///
+/// `*done` counts the null character, if it was reached.
+ExceptionType
+MMU::ReadString(unsigned addr, char *buffer, unsigned maxSize,
+                unsigned *done)
+{
+    ASSERT(buffer != nullptr);
+    ASSERT(done != nullptr);
+    DEBUG('a', "Reading string at VA 0x%X, size %u\n", addr, maxSize);
+
+    *done = 0;
+    while (*done < maxSize) {
+        char *host;
+        ExceptionType e = TranslateBlock(addr + *done, false, &host);
+        if (e != NO_EXCEPTION)
+            return e;
+
+        unsigned n = PAGE_SIZE - (addr + *done) % PAGE_SIZE;
+        if (n > maxSize - *done)
+            n = maxSize - *done;
+        const char *end = (const char *) memchr(host, '\0', n);
+        if (end != nullptr)
+            n = end - host + 1;
+        memcpy(buffer + *done, host, n);
+        *done += n;
+        if (end != nullptr)
+            break;
+    }
+    return NO_EXCEPTION;
+}
+
+/// Fetch the instruction at `addr`, decoding it only if its frame has
+/// changed since the last time it was fetched.
+///
+/// * `addr` is the virtual address of the instruction.
+/// * `instr` is the place to store a pointer to the decoded instruction.
+///   The pointed object belongs to the MMU and is only valid until the
+///   next write to main memory.
+ExceptionType
+MMU::FetchInstruction(unsigned addr, const Instruction **instr)
+{
+    ASSERT(instr != nullptr);
+    DEBUG('a', "Fetching VA 0x%X\n", addr);
+
+    // A new instruction: it has not accessed any data yet.
+    pinnedCode = addr / PAGE_SIZE;
+    pinnedData = (unsigned) -1;
+
+    const char *host = SoftTranslate(addr, 4, false);
+    unsigned physicalAddress;
+    if (host != nullptr)
+        physicalAddress = host - mainMemory;
+    else {
+        ExceptionType e = Translate(addr, &physicalAddress, 4, false);
+        if (e != NO_EXCEPTION)
+            return e;
+    }
+
+    if (instrCache != nullptr)
+        AccessCache(instrCache, physicalAddress, false,
+                    &iCacheHits, &iCacheMisses);
+    *instr = decodeCache.Get(mainMemory, physicalAddress);
+    return NO_EXCEPTION;
+}
+
+/// Fetch the basic block starting at `addr`.
+///
+/// * `addr` is the virtual address of the first instruction.
+/// * `block` is the place to store a pointer to the decoded instructions,
+///   which belong to the MMU.
+/// * `length` is the place to store the number of instructions.
+/// * `physAddr` is the place to store the physical address of the block.
 ExceptionType
-MMU::RetrievePageEntry(unsigned vpn, TranslationEntry **entry) const
+MMU::FetchBlock(unsigned addr, const Instruction **block, unsigned *length,
+                unsigned *physAddr)
+{
+    ASSERT(block != nullptr);
+    ASSERT(length != nullptr);
+    ASSERT(physAddr != nullptr);
+    DEBUG('a', "Fetching block at VA 0x%X\n", addr);
+
+    pinnedCode = addr / PAGE_SIZE;
+    pinnedData = (unsigned) -1;
+
+    const char *host = SoftTranslate(addr, 4, false);
+    unsigned physicalAddress;
+    if (host != nullptr)
+        physicalAddress = host - mainMemory;
+    else {
+        ExceptionType e = Translate(addr, &physicalAddress, 4, false);
+        if (e != NO_EXCEPTION)
+            return e;
+    }
+
+    if (instrCache != nullptr)
+        AccessCache(instrCache, physicalAddress, false,
+                    &iCacheHits, &iCacheMisses);
+    *block = decodeCache.GetBlock(mainMemory, physicalAddress, length);
+    *physAddr = physicalAddress;
+    return NO_EXCEPTION;
+}
+
+void
+MMU::FetchFromBlock(unsigned physAddr)
+{
+    AccessCache(instrCache, physAddr, false,
+                &iCacheHits, &iCacheMisses);
+}
+
+/// Cache misses stall for a line fill, and writes that reach memory, for a
+/// write through or a write back, for a memory write.
+inline void
+MMU::AccessCache(Cache *cache, unsigned physAddr, bool writing,
+                 unsigned long *hits, unsigned long *misses)
+{
+    unsigned events = cache->Access(physAddr, writing);
+    if (events & CACHE_MISS) {
+        (*misses)++;
+        machine->Stall(machine->GetCostModel()->cacheMiss);
+    } else
+        (*hits)++;
+    if (events & CACHE_MEMORY_WRITE)
+        ChargeMemoryWrites(1);
+}
+
+void
+MMU::ChargeMemoryWrites(unsigned n)
+{
+    memoryWrites += n;
+    machine->Stall(n * machine->GetCostModel()->memoryWrite);
+}
+
+/// The counters are kept per MMU, so that CPUs running user code at the
+/// same time do not race on the global statistics.
+void
+MMU::FlushCacheStats()
+{
+    stats->numICacheHits   += iCacheHits;
+    stats->numICacheMisses += iCacheMisses;
+    stats->numDCacheHits   += dCacheHits;
+    stats->numDCacheMisses += dCacheMisses;
+    stats->numMemoryWrites += memoryWrites;
+    iCacheHits   = 0;
+    iCacheMisses = 0;
+    dCacheHits   = 0;
+    dCacheMisses = 0;
+    memoryWrites = 0;
+}
+
+void
+MMU::SetCaches(Cache *instr, Cache *data)
+{
+    delete instrCache;
+    delete dataCache;
+    instrCache = instr;
+    dataCache  = data;
+}
+
+/// Dirty lines of a write back data cache are written back before the
+/// frame is replaced, and that is charged as any other memory write.
+void
+MMU::ForgetFrame(unsigned frame)
+{
+    decodeCache.InvalidateFrame(frame);
+    if (instrCache != nullptr)
+        instrCache->Invalidate(frame * PAGE_SIZE, PAGE_SIZE);
+    if (dataCache != nullptr) {
+        unsigned dirty = dataCache->Invalidate(frame * PAGE_SIZE, PAGE_SIZE);
+        if (dirty > 0)
+            ChargeMemoryWrites(dirty);
+    }
+}
+
+void
+MMU::InvalidateFrame(unsigned frame)
+{
+    ASSERT(frame < numPhysPages);
+    ForgetFrame(frame);
+    FlushSoftTlb();
+}
+
+void
+MMU::InvalidateFrameLater(unsigned frame)
+{
+    ASSERT(frame < numPhysPages);
+    staleFrames[frame] = true;
+    anyStaleFrame = true;
+}
+
+/// Replace the TLB with an empty one of a new shape.
+///
+/// * `size` is the total number of entries.
+/// * `ways` is the number of entries per set; it must divide `size`.
+///   `ways == size` gives a fully associative TLB.
+///
+/// A set must be able to hold at least two entries: an instruction may need
+/// the translation of its own page and of the data it accesses, and if both
+/// pages evicted each other from the same set, it would never complete.
+void
+MMU::ConfigureTlb(unsigned size, unsigned ways)
+{
+    ASSERT(ways >= 2 && size % ways == 0);
+
+    delete [] tlb;
+    delete [] tlbNext;
+    delete [] tlbReferenced;
+    delete [] tlbAge;
+
+    tlbSize       = size;
+    tlbWays       = ways;
+    tlbSets       = size / ways;
+    tlb           = new TranslationEntry [tlbSize];
+    tlbNext       = new unsigned [tlbSets];
+    tlbReferenced = new bool [tlbSize];
+    tlbAge        = new unsigned char [tlbSize];
+    for (unsigned i = 0; i < tlbSize; i++) {
+        tlb[i].valid     = false;
+        tlbReferenced[i] = false;
+        tlbAge[i]        = 0;
+    }
+    for (unsigned i = 0; i < tlbSets; i++)
+        tlbNext[i] = 0;
+    FlushSoftTlb();
+}
+
+/// Load a translation into the TLB, in the set of its virtual page.
+///
+/// * `entry` is the translation to load; it is copied.
+void
+MMU::RefillTlb(const TranslationEntry &entry)
+{
+    ASSERT(tlb != nullptr);
+
+    // A set has at least two entries, and only the code page of the
+    // current instruction can be pinned besides `entry` itself, so there
+    // is always a victim.
+    unsigned i = ChooseTlbVictim(entry.virtualPage % tlbSets);
+    ASSERT(i < tlbSize);
+    LoadTlbEntry(entry, i);
+    machine->Stall(machine->GetCostModel()->tlbRefill);
+}
+
+/// Load a translation into the TLB, unless it is already there, or there is
+/// no room for it in its set without evicting a pinned entry.
+///
+/// * `entry` is the translation to load; it is copied.
+bool
+MMU::PrefetchTlb(const TranslationEntry &entry)
+{
+    ASSERT(tlb != nullptr);
+
+    unsigned set = entry.virtualPage % tlbSets;
+    for (unsigned i = set * tlbWays; i < (set + 1) * tlbWays; i++)
+        if (tlb[i].valid && tlb[i].virtualPage == entry.virtualPage
+              && tlb[i].asid == currentAsid)
+            return false;
+
+    unsigned i = ChooseTlbVictim(set);
+    if (i == tlbSize)
+        return false;
+    LoadTlbEntry(entry, i);
+    stats->numTlbPrefetches++;
+    return true;
+}
+
+void
+MMU::SetTlbPolicy(TlbPolicy policy)
+{
+    tlbPolicy = policy;
+}
+
+void
+MMU::SetTlbPrefetch(bool on)
+{
+    tlbPrefetch = on;
+}
+
+inline bool
+MMU::IsPinned(unsigned i) const
+{
+    return tlb[i].valid && tlb[i].asid == currentAsid
+           && (tlb[i].virtualPage == pinnedCode
+               || tlb[i].virtualPage == pinnedData);
+}
+
+/// Choose the entry of a set to replace, according to `tlbPolicy`.
+///
+/// Except under FIFO, free entries are taken first.  Ties are broken
+/// round robin, starting from `tlbNext`.
+unsigned
+MMU::ChooseTlbVictim(unsigned set)
+{
+    unsigned first = set * tlbWays;
+
+    if (tlbPolicy == TLB_FIFO) {
+        for (unsigned n = 0; n < tlbWays; n++) {
+            unsigned i = first + tlbNext[set];
+            tlbNext[set] = (tlbNext[set] + 1) % tlbWays;
+            if (!IsPinned(i))
+                return i;
+        }
+        return tlbSize;
+    }
+
+    unsigned start = tlbPolicy == TLB_RANDOM
+                     ? SystemDep::Random() % tlbWays : tlbNext[set];
+    unsigned chosen = tlbSize;
+    unsigned chosenKey = 0;
+    for (unsigned n = 0; n < tlbWays; n++) {
+        unsigned i = first + (start + n) % tlbWays;
+        if (!tlb[i].valid) {
+            chosen = i;
+            break;
+        }
+        if (IsPinned(i))
+            continue;
+
+        // Lower keys are better victims.
+        unsigned key;
+        switch (tlbPolicy) {
+            case TLB_NRU:
+                key = ((tlbReferenced[i] || tlbAge[i] & 0x80) ? 2 : 0)
+                      + (tlb[i].dirty ? 1 : 0);
+                break;
+            case TLB_LRU:
+                key = (tlbReferenced[i] ? 0x100 : 0) | tlbAge[i];
+                break;
+            default:
+                key = 0;  // The first one will do.
+        }
+        if (chosen == tlbSize || key < chosenKey) {
+            chosen    = i;
+            chosenKey = key;
+        }
+    }
+
+    if (chosen != tlbSize)
+        tlbNext[set] = (chosen - first + 1) % tlbWays;
+    return chosen;
+}
+
+/// Age the reference bits of the entries of a set.
+///
+/// References are only recorded by `Translate`; the soft TLB, which would
+/// hide them, is flushed by the refill that follows a miss.
+void
+MMU::AgeTlbSet(unsigned set)
+{
+    for (unsigned i = set * tlbWays; i < (set + 1) * tlbWays; i++) {
+        tlbAge[i] = (tlbAge[i] >> 1) | (tlbReferenced[i] ? 0x80 : 0);
+        tlbReferenced[i] = false;
+    }
+}
+
+TranslationEntry *
+MMU::LoadTlbEntry(const TranslationEntry &entry, unsigned i)
+{
+    tlb[i] = entry;
+    tlb[i].asid = currentAsid;
+    tlbReferenced[i] = false;
+    tlbAge[i]        = 0;
+    stats->numTlbRefills++;
+    FlushSoftTlb();
+    return &tlb[i];
+}
+
+void
+MMU::FlushTlb()
+{
+    ASSERT(tlb != nullptr);
+
+    for (unsigned i = 0; i < tlbSize; i++)
+        tlb[i].valid = false;
+    FlushSoftTlb();
+}
+
+void
+MMU::SetTlbWalker(bool on)
+{
+    tlbWalker = on;
+}
+
+/// Switch to another address space identifier.
+///
+/// The soft TLB does not record identifiers, so it has to go.
+void
+MMU::SetAsid(unsigned asid)
+{
+    ASSERT(asid < NUM_TLB_ASIDS);
+
+    currentAsid = asid;
+    FlushSoftTlb();
+}
+
+void
+MMU::SetTrace(MemTrace *t)
+{
+    trace = t;
+}
+
+MemTrace *
+MMU::GetTrace() const
+{
+    return trace;
+}
+
+void
+MMU::FlushSoftTlb()
+{
+    if (anyStaleFrame) {
+        for (unsigned i = 0; i < numPhysPages; i++)
+            if (staleFrames[i]) {
+                ForgetFrame(i);
+                staleFrames[i] = false;
+            }
+        anyStaleFrame = false;
+    }
+    for (unsigned i = 0; i < SOFT_TLB_SIZE; i++) {
+        softTlb[i].virtualPage = (unsigned) -1;
+        softTlb[i].readBase    = nullptr;
+        softTlb[i].writeBase   = nullptr;
+    }
+}
+
+ExceptionType
+MMU::RetrievePageEntry(unsigned vpn, TranslationEntry **entry)
 {
     ASSERT(entry != nullptr);
 
@@ -170,17 +763,42 @@ MMU::RetrievePageEntry(unsigned vpn, TranslationEntry **entry) const
     } else {
         // Use the TLB.
 
-        unsigned i;
-        for (i = 0; i < TLB_SIZE; i++)
-            if (tlb[i].valid && tlb[i].virtualPage == vpn) {
+        // Only the set the page maps to needs to be searched.
+        unsigned first = (vpn % tlbSets) * tlbWays;
+        for (unsigned i = first; i < first + tlbWays; i++)
+            if (tlb[i].valid && tlb[i].virtualPage == vpn
+                  && tlb[i].asid == currentAsid) {
                 *entry = &tlb[i];  // FOUND!
-                //stats->numPageHits++;
+                stats->numTlbHits++;
                 return NO_EXCEPTION;
             }
 
         // Not found.
+        stats->numTlbMisses++;
+        if (tlbPolicy == TLB_NRU || tlbPolicy == TLB_LRU)
+            AgeTlbSet(vpn % tlbSets);
+
+        // Let the walker refill the TLB, if the page table has a mapping
+        // for the page.  Pages that are not valid, or not resident in
+        // memory, are left to the kernel.
+        if (tlbWalker && pageTable != nullptr && vpn < pageTableSize
+              && pageTable[vpn].valid
+              && pageTable[vpn].physicalPage < numPhysPages) {
+            DEBUG_CONT('a', "TLB refilled from the page table, ");
+            unsigned i = ChooseTlbVictim(vpn % tlbSets);
+            ASSERT(i < tlbSize);
+            *entry = LoadTlbEntry(pageTable[vpn], i);
+            stats->numTlbWalks++;
+            machine->Stall(machine->GetCostModel()->tlbRefill);
+
+            unsigned next = vpn + 1;
+            if (tlbPrefetch && next < pageTableSize && pageTable[next].valid
+                  && pageTable[next].physicalPage < numPhysPages)
+                PrefetchTlb(pageTable[next]);
+            return NO_EXCEPTION;
+        }
+
         DEBUG_CONT('a', "no valid TLB entry found for this virtual page!\n");
-        //stats->numPageFaults++;
         return PAGE_FAULT_EXCEPTION;  // Really, this is a TLB fault, the
                                       // page may be in memory, but not in
                                       // the TLB.
@@ -204,8 +822,9 @@ MMU::Translate(unsigned virtAddr, unsigned *physAddr,
                unsigned size, bool writing)
 {
     ASSERT(physAddr != nullptr);
-    // We must have either a TLB or a page table, but not both!
-    ASSERT((tlb == nullptr) != (pageTable == nullptr));
+    // We must have either a TLB or a page table.  If there are both, the
+    // page table is only read by the walker, to refill the TLB.
+    ASSERT(tlb != nullptr || pageTable != nullptr);
 
     DEBUG('a', "\tTranslate: ");
 
@@ -237,18 +856,34 @@ MMU::Translate(unsigned virtAddr, unsigned *physAddr,
 
     // If the `pageFrame` is too big, there is something really wrong!  An
     // invalid translation was loaded into the page table or TLB.
-    if (pageFrame >= NUM_PHYS_PAGES) {
-        DEBUG_CONT('a', "frame %u > %u!\n", pageFrame, NUM_PHYS_PAGES);
+    if (pageFrame >= numPhysPages) {
+        DEBUG_CONT('a', "frame %u > %u!\n", pageFrame, numPhysPages);
         return BUS_ERROR_EXCEPTION;
     }
 
     // Set the `use` and `dirty` flags.
     entry->use = true;
+    if (tlb != nullptr)
+        tlbReferenced[entry - tlb] = true;
     if (writing)
         entry->dirty = true;
 
     *physAddr = pageFrame * PAGE_SIZE + offset;
-    ASSERT(*physAddr >= 0 && *physAddr + size <= MEMORY_SIZE);
+    ASSERT(*physAddr >= 0 && *physAddr + size <= numPhysPages * PAGE_SIZE);
     DEBUG_CONT('a', "physical address 0x%X\n", *physAddr);
+
+    // Remember the translation, so that the next accesses to the page can
+    // skip all of the above.  Not while tracing addresses, so that every
+    // translation shows up in the trace.
+    if (!debug.IsEnabled('a')) {
+        SoftTlbEntry *soft = &softTlb[vpn % SOFT_TLB_SIZE];
+        if (soft->virtualPage != vpn) {
+            soft->virtualPage = vpn;
+            soft->writeBase   = nullptr;
+        }
+        soft->readBase = &mainMemory[pageFrame * PAGE_SIZE];
+        if (writing)
+            soft->writeBase = soft->readBase;
+    }
     return NO_EXCEPTION;
 }
@@ -9,27 +9,72 @@
 #define NACHOS_MACHINE_MMU__HH
 
 
+#include "cache.hh"
+#include "decode_cache.hh"
 #include "exception_type.hh"
 #include "disk.hh"
+#include "mem_trace.hh"
 #include "translation_entry.hh"
 
 
 /// Definitions related to the size, and format of user memory.
 
-const unsigned PAGE_SIZE = SECTOR_SIZE;  ///< Set the page size equal to the
-                                         ///< disk sector size, for
-                                         ///< simplicity.
-const unsigned NUM_PHYS_PAGES = 64;
-const unsigned MEMORY_SIZE = NUM_PHYS_PAGES * PAGE_SIZE;
-const unsigned TLB_SIZE = 4;  ///< if there is a TLB, make it small.
+/// Disk sectors in a page.  A build may set it with `-DPAGE_SECTORS=n`;
+/// with more than one, swapping and loading a page from an executable move
+/// several sectors at a time.
+#ifndef PAGE_SECTORS
+#define PAGE_SECTORS 1
+#endif
+
+const unsigned PAGE_SIZE = PAGE_SECTORS * SECTOR_SIZE;  ///< Size of a page,
+                                                        ///< a whole number
+                                                        ///< of sectors.
+const unsigned DEFAULT_NUM_PHYS_PAGES = 64;  ///< Frames of main memory,
+                                            ///< unless told otherwise.
+const unsigned MAX_MEMORY_SIZE = 1U << 30;  ///< Largest main memory.
+const unsigned TLB_SIZE = 4;  ///< Default number of TLB entries; if
+                              ///< there is a TLB, make it small.
+const unsigned NUM_TLB_ASIDS = 64;  ///< Address space identifiers the TLB
+                                    ///< can tell apart.
+const unsigned SOFT_TLB_SIZE = 64;  ///< Entries of the soft TLB; must be a
+                                    ///< power of two.
+
+
+/// Ways of choosing which entry of a TLB set to replace on a refill.
+enum TlbPolicy {
+    TLB_FIFO,    ///< Round robin: the entry loaded the longest ago.
+    TLB_RANDOM,  ///< Any entry, at random.
+    TLB_NRU,     ///< An entry not referenced since the last miss in the
+                 ///< set, preferring clean ones.
+    TLB_LRU      ///< The least recently used entry, approximated by aging
+                 ///< the reference bits on every miss in the set.
+};
+
+
+/// An entry of the soft TLB: a direct host mapping for a virtual page whose
+/// translation has already been checked.
+///
+/// `readBase` and `writeBase` point to the start of the frame in
+/// `mainMemory`.  Each is only set after a read (or write) of the page went
+/// through the full translation, so by then the `use` (and `dirty`) bit of
+/// the translation entry is already set.
+struct SoftTlbEntry {
+    unsigned virtualPage;
+    char *readBase;
+    char *writeBase;
+};
 
 
 /// This class simulates an MMU (memory management unit) that can use either
 /// page tables or a TLB.
 class MMU {
 public:
-    // Initialize the MMU subsystem.
-    MMU();
+    // Initialize the MMU subsystem, with `numPhysPages` frames of main
+    // memory.
+    //
+    // If `memory` is not null, it is the main memory of another CPU, to be
+    // shared rather than allocated.
+    MMU(char *memory, unsigned numPhysPages);
 
     // Deallocate data structures.
     ~MMU();
@@ -41,6 +86,138 @@ public:
 
     ExceptionType WriteMem(unsigned addr, unsigned size, int value);
 
+    /// Copy `size` bytes of virtual memory starting at `addr` into
+    /// `buffer`, or the other way around.
+    ///
+    /// Each page is translated once, and copied whole.  On an exception,
+    /// `*done` tells how many bytes were copied before the faulting address.
+
+    ExceptionType ReadBlock(unsigned addr, char *buffer, unsigned size,
+                            unsigned *done);
+
+    ExceptionType WriteBlock(unsigned addr, const char *buffer,
+                             unsigned size, unsigned *done);
+
+    /// Like `ReadBlock`, but stop after copying a null character.
+    ExceptionType ReadString(unsigned addr, char *buffer, unsigned maxSize,
+                             unsigned *done);
+
+    /// Fetch the instruction at virtual address `addr`, already decoded.
+    ///
+    /// The translation is checked as for a 4-byte read, but the word is
+    /// only decoded the first time it is fetched from its physical frame.
+    ExceptionType FetchInstruction(unsigned addr,
+                                   const Instruction **instr);
+
+    /// Fetch the basic block starting at virtual address `addr`, already
+    /// decoded.
+    ///
+    /// Only the first instruction is translated; the rest of the block is
+    /// in the same page.  `*length` is set to the number of instructions,
+    /// and `*physAddr` to the physical address of the first.
+    ExceptionType FetchBlock(unsigned addr, const Instruction **block,
+                             unsigned *length, unsigned *physAddr);
+
+    /// Account the fetch of an instruction of a block already fetched, at
+    /// physical address `physAddr`, in the instruction cache.
+    void FetchFromBlock(unsigned physAddr);
+
+    /// Number of times decoded instructions have been invalidated.
+    unsigned long GetDecodeGeneration() const;
+
+    /// Forget the decoded instructions of a physical frame.
+    ///
+    /// The kernel must call this whenever a frame is reassigned, or its
+    /// contents are changed without going through `WriteMem`.
+    void InvalidateFrame(unsigned frame);
+
+    /// Forget the decoded instructions of a frame at the next
+    /// `FlushSoftTlb`.
+    ///
+    /// For the MMU of another CPU, which may be running user code
+    /// meanwhile, but cannot run the frame's new contents before switching
+    /// address spaces.
+    void InvalidateFrameLater(unsigned frame);
+
+    /// Give the TLB `size` entries, grouped in sets of `ways` entries.
+    ///
+    /// A virtual page can only be cached in the set given by its number
+    /// modulo the number of sets.  The TLB starts empty.  By default, it has
+    /// `TLB_SIZE` entries and is fully associative.
+    void ConfigureTlb(unsigned size, unsigned ways);
+
+    /// Load `entry` into the TLB, replacing one of the entries of the set
+    /// its virtual page maps to, as chosen by the replacement policy.
+    ///
+    /// The new entry is tagged with the current address space identifier.
+    void RefillTlb(const TranslationEntry &entry);
+
+    /// Load `entry` into the TLB ahead of its use, if it is not there yet.
+    ///
+    /// Unlike `RefillTlb`, this gives up rather than replace an entry the
+    /// current instruction needs.  Return true if the entry was loaded.
+    bool PrefetchTlb(const TranslationEntry &entry);
+
+    /// Choose TLB victims with `policy`; the default is `TLB_FIFO`.
+    void SetTlbPolicy(TlbPolicy policy);
+
+    /// Turn prefetching of the next page's translation on a TLB miss on or
+    /// off.
+    ///
+    /// The page table walker prefetches by itself; a kernel refilling the
+    /// TLB should call `PrefetchTlb` when this is on.
+    void SetTlbPrefetch(bool on);
+    bool GetTlbPrefetch() const;
+
+    /// Invalidate every entry of the TLB, of all address spaces.
+    void FlushTlb();
+
+    /// Turn the hardware page table walker on or off.
+    ///
+    /// With the walker on, a TLB miss is refilled by the MMU itself from
+    /// `pageTable`, and only traps to the kernel if the entry there is not
+    /// valid or does not map a physical frame.  It is off by default, so
+    /// every miss traps.
+    void SetTlbWalker(bool on);
+
+    /// Run with address space identifier `asid`, less than
+    /// `NUM_TLB_ASIDS`.
+    ///
+    /// From now on, only TLB entries loaded under the same identifier
+    /// match, so entries of other address spaces need not be flushed on a
+    /// context switch.
+    void SetAsid(unsigned asid);
+
+    /// Current address space identifier.
+    unsigned GetAsid() const;
+
+    /// Hand every reference of `ReadMem` and `WriteMem` to `t`, or stop
+    /// tracing if it is null.
+    void SetTrace(MemTrace *t);
+
+    MemTrace *GetTrace() const;
+
+    /// Simulate `instr` and `data` as the level 1 caches of instructions
+    /// and of data; either may be null, for none, as by default.
+    ///
+    /// The MMU takes ownership of them.  The caches of different CPUs are
+    /// not kept coherent.
+    void SetCaches(Cache *instr, Cache *data);
+
+    /// Whether there is an instruction cache to account fetches in.
+    bool HasInstructionCache() const;
+
+    /// Add the cache hits, misses and memory writes counted since the last
+    /// call to `stats`.  The kernel lock must be held.
+    void FlushCacheStats();
+
+    /// Forget every mapping of the soft TLB.
+    ///
+    /// The kernel must call this whenever it changes the TLB, the page
+    /// table or the `use` and `dirty` bits it relies on, and when it
+    /// switches address spaces.
+    void FlushSoftTlb();
+
     /// Data structures -- all of these are accessible to Nachos kernel code.
     /// “Public” for convenience.
     ///
@@ -50,6 +227,8 @@ public:
 
     char *mainMemory;  ///< Physical memory to store user program,
                        ///< code and data, while executing.
+    unsigned numPhysPages;  ///< Number of frames in `mainMemory`, also
+                            ///< read-only.
 
     /// NOTE: the hardware translation of virtual addresses in the user
     /// program to physical addresses (relative to the beginning of
@@ -62,6 +241,9 @@ public:
     /// If `tlb` is non-null, the Nachos kernel is responsible for managing
     /// the contents of the TLB.  But the kernel can use any data structure
     /// it wants (eg, segmented paging) for handling TLB cache misses.
+    /// Unless the page table walker is on: then the kernel must also keep
+    /// `pageTable` pointing to the linear page table of the current address
+    /// space, which the MMU reads to refill the TLB.
     ///
     /// For simplicity, both the page table pointer and the TLB pointer are
     /// public.  However, while there can be multiple page tables (one per
@@ -72,14 +254,112 @@ public:
 
     TranslationEntry *tlb;  ///< This pointer should be considered
                             ///< “read-only” to Nachos kernel code.
+    unsigned tlbSize;  ///< Number of entries in `tlb`, also read-only.
 
     TranslationEntry *pageTable;
     unsigned pageTableSize;
 private:
 
+    /// Shape of the TLB: `tlbSets` sets of `tlbWays` consecutive entries.
+    unsigned tlbSets;
+    unsigned tlbWays;
+
+    /// Next entry to replace in each set, round robin.
+    unsigned *tlbNext;
+
+    TlbPolicy tlbPolicy;
+    bool tlbPrefetch;
+
+    /// Whether each TLB entry has been referenced since the last miss in
+    /// its set.  The `use` bit of the entries cannot be cleared for this,
+    /// as the kernel relies on it for page replacement.
+    bool *tlbReferenced;
+
+    /// Reference history of each TLB entry: shifted right on every miss in
+    /// its set, with the reference bit entering at the top.
+    unsigned char *tlbAge;
+
+    /// Virtual pages of the instruction being executed and of the data it
+    /// last accessed.  Their TLB entries are never replaced in favor of
+    /// another entry, so that an instruction is not kept from completing.
+    unsigned pinnedCode;
+    unsigned pinnedData;
+
+    /// Address space identifier the TLB is matched against.
+    unsigned currentAsid;
+
+    /// Whether TLB misses are refilled from `pageTable` by the MMU.
+    bool tlbWalker;
+
+    /// Where memory references are recorded, if tracing.
+    MemTrace *trace;
+
+    /// Level 1 caches, or null.
+    Cache *instrCache;
+    Cache *dataCache;
+
+    /// Cache events not yet added to `stats`.
+    unsigned long iCacheHits;
+    unsigned long iCacheMisses;
+    unsigned long dCacheHits;
+    unsigned long dCacheMisses;
+    unsigned long memoryWrites;
+
+    /// Account a reference to `physAddr` in `cache`, in the counters
+    /// `*hits` and `*misses`, and stall for it as the cost model says.
+    void AccessCache(Cache *cache, unsigned physAddr, bool writing,
+                     unsigned long *hits, unsigned long *misses);
+
+    /// Account `n` writes from the data cache to memory, and stall for
+    /// them.
+    void ChargeMemoryWrites(unsigned n);
+
+    /// Forget everything cached about `frame`, whose contents changed.
+    void ForgetFrame(unsigned frame);
+
+    /// Whether `mainMemory` belongs to another CPU.
+    bool sharedMemory;
+
+    /// Decoded instructions of the frames in `mainMemory`.
+    DecodeCache decodeCache;
+
+    /// Frames to drop from `decodeCache` at the next `FlushSoftTlb`, and
+    /// whether there is any.
+    bool *staleFrames;
+    bool anyStaleFrame;
+
+    /// Direct-mapped cache of the last translations, indexed by virtual
+    /// page number.  Lets most accesses skip `Translate` altogether.
+    SoftTlbEntry softTlb[SOFT_TLB_SIZE];
+
+    /// Look `virtAddr` up in the soft TLB.
+    ///
+    /// Return the host address of the data, or null if the access must go
+    /// through `Translate`.
+    char *SoftTranslate(unsigned virtAddr, unsigned size, bool writing);
+
+    /// Whether TLB entry `i` holds a pinned page of the current address
+    /// space.
+    bool IsPinned(unsigned i) const;
+
+    /// Pick the entry of `set` to replace; return `tlbSize` if every entry
+    /// in it is pinned.
+    unsigned ChooseTlbVictim(unsigned set);
+
+    /// Record a miss in `set`, aging the reference bits of its entries.
+    void AgeTlbSet(unsigned set);
+
+    /// Copy `entry` into TLB entry `i`, tagged with the current address
+    /// space identifier, and return it.
+    TranslationEntry *LoadTlbEntry(const TranslationEntry &entry,
+                                   unsigned i);
+
+    /// Translate the page of `addr` for a block copy, and return the host
+    /// address `addr` maps to in `*host`.
+    ExceptionType TranslateBlock(unsigned addr, bool writing, char **host);
+
     /// Retrieve a page entry either from a page table or the TLB.
-    ExceptionType RetrievePageEntry(unsigned vpn,
-                                    TranslationEntry **entry) const;
+    ExceptionType RetrievePageEntry(unsigned vpn, TranslationEntry **entry);
 
     /// Translate an address, and check for alignment.
     ///
@@ -89,4 +369,30 @@ private:
     ExceptionType Translate(unsigned virtAddr, unsigned *physAddr,
                             unsigned size, bool writing);
 };
+
+inline bool
+MMU::GetTlbPrefetch() const
+{
+    return tlbPrefetch;
+}
+
+inline unsigned
+MMU::GetAsid() const
+{
+    return currentAsid;
+}
+
+inline bool
+MMU::HasInstructionCache() const
+{
+    return instrCache != nullptr;
+}
+
+inline unsigned long
+MMU::GetDecodeGeneration() const
+{
+    return decodeCache.GetGeneration();
+}
+
+
 #endif
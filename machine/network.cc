@@ -88,18 +88,44 @@ Network::CheckPktAvail()
 
     if (inHdr.length != 0)  // Do nothing if packet is already buffered.
         return;
+
+    // When replaying, the packet comes from the log, if one came then.
+    Replay *replay = interrupt->GetReplay();
+    if (replay != nullptr && replay->IsReplaying()) {
+        char *buffer = new char [MAX_WIRE_SIZE];
+        bool arrived = replay->Play(buffer, MAX_WIRE_SIZE) > 0;
+        if (arrived)
+            Deliver(buffer);
+        delete [] buffer;
+        return;
+    }
+
     if (!SystemDep::PollSocket(sock))  // Do nothing if no packet to be read.
         return;
 
     // Otherwise, read packet in.
     char *buffer = new char [MAX_WIRE_SIZE];
     SystemDep::ReadFromSocket(sock, buffer, MAX_WIRE_SIZE);
+    if (replay != nullptr) {  // `Deliver` rejects any longer packet.
+        unsigned length = ((PacketHeader *) buffer)->length;
+        if (length > MAX_PACKET_SIZE)
+            length = MAX_PACKET_SIZE;
+        replay->Record(buffer, sizeof (PacketHeader) + length);
+    }
+    Deliver(buffer);
+    delete [] buffer;
+}
+
+/// Take in the packet in `buffer`, and tell the post office about it.
+void
+Network::Deliver(const char *buffer)
+{
+    ASSERT(buffer != nullptr);
 
     // Divide packet into header and data.
     inHdr = *(PacketHeader *) buffer;
     ASSERT(inHdr.to == ident && inHdr.length <= MAX_PACKET_SIZE);
     memcpy(inbox, buffer + sizeof (PacketHeader), inHdr.length);
-    delete [] buffer;
 
     DEBUG('n', "Network received packet from %d, length %u...\n",
           (int) inHdr.from, inHdr.length);
@@ -145,6 +171,11 @@ Network::Send(PacketHeader hdr, const char *data)
         return;
     }
 
+    // When replaying, the machines we talked to are not listening.
+    Replay *replay = interrupt->GetReplay();
+    if (replay != nullptr && replay->IsReplaying())
+        return;
+
     // Concatenate `hdr` and `data` into a single buffer, and send it out.
     char *buffer = new char [MAX_WIRE_SIZE];
     *(PacketHeader *) buffer = hdr;
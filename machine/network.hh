@@ -94,6 +94,9 @@ public:
 
 private:
 
+    /// Take in the packet in `buffer`, as read from the wire.
+    void Deliver(const char *buffer);
+
     /// This machine's network address.
     NetworkAddress ident;
 
@@ -0,0 +1,388 @@
+/// Routines to count the instructions run by user programs and report the
+/// hottest ones.
+///
+/// Copyright (c) 2016-2020 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+
+#include "profiler.hh"
+#include "lib/utility.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/// Counts of one address space.  The per instruction arrays are indexed by
+/// the word address of the instruction, and grow as the program runs
+/// further in its address space.
+struct Profiler::SpaceProfile {
+    unsigned numWords;         ///< Length of the arrays below.
+    unsigned long *runs;       ///< Times each instruction was run.
+    unsigned long *entries;    ///< Times a block was entered there.
+    unsigned long *blockRuns;  ///< Instructions run in the blocks entered
+                               ///< there.
+    unsigned long total;       ///< Instructions run.
+
+    unsigned expectedPc;  ///< Where the program goes if it does not jump.
+    unsigned block;       ///< Word where the running block was entered.
+
+    bool calling;    ///< A call was run; the next block is its target.
+    bool returning;  ///< A return was run; the next block is the caller's.
+    unsigned linkPc; ///< Where a call that is not taken falls through.
+
+    unsigned depth;     ///< Depth of the call stack running.
+    unsigned overflow;  ///< Frames not told apart, below the deepest.
+
+    StackNode *stacks;  ///< Call stacks seen, with their counts; the first
+                        ///< is the empty one.
+    unsigned numStacks;
+    unsigned maxStacks;
+    unsigned *chains;   ///< First call stack of each of `maxStacks` hash
+                        ///< chains, by parent and function entered.
+    unsigned stack;     ///< Index of the call stack running.
+};
+
+/// Parent of the empty call stack, and end of a hash chain.
+static const unsigned NO_STACK = (unsigned) -1;
+
+/// Hash chain of the call stack `parent` with a call to `pc` on top, among
+/// `numChains`, a power of two.
+static inline unsigned
+StackHash(unsigned parent, unsigned pc, unsigned numChains)
+{
+    return (parent * 2654435761U ^ pc / 4) & (numChains - 1);
+}
+
+Profiler::Profiler(const char *foldedFile_)
+{
+    foldedFile = foldedFile_;
+    spaces     = nullptr;
+    numSpaces  = 0;
+    current    = nullptr;
+}
+
+Profiler::~Profiler()
+{
+    for (unsigned i = 0; i < numSpaces; i++) {
+        SpaceProfile *p = spaces[i];
+        if (p == nullptr)
+            continue;
+        delete [] p->runs;
+        delete [] p->entries;
+        delete [] p->blockRuns;
+        delete [] p->stacks;
+        delete [] p->chains;
+        delete p;
+    }
+    delete [] spaces;
+}
+
+Profiler::SpaceProfile *
+Profiler::GetSpace(unsigned space)
+{
+    if (space >= numSpaces) {
+        unsigned n = numSpaces * 2 > space ? numSpaces * 2 : space + 1;
+        SpaceProfile **s = new SpaceProfile *[n];
+        for (unsigned i = 0; i < n; i++)
+            s[i] = i < numSpaces ? spaces[i] : nullptr;
+        delete [] spaces;
+        spaces    = s;
+        numSpaces = n;
+    }
+
+    if (spaces[space] == nullptr) {
+        SpaceProfile *p = new SpaceProfile;
+        p->numWords   = 0;
+        p->runs       = nullptr;
+        p->entries    = nullptr;
+        p->blockRuns  = nullptr;
+        p->total      = 0;
+        p->expectedPc = 1;  // Never the address of an instruction.
+        p->block      = 0;
+        p->calling    = true;  // The first block is the outermost frame.
+        p->returning  = false;
+        p->linkPc     = 1;
+        p->depth      = 0;
+        p->overflow   = 0;
+        p->stacks     = nullptr;
+        p->numStacks  = 0;
+        p->maxStacks  = 0;
+        p->chains     = nullptr;
+        GrowStacks(p);
+        p->stack      = FindStack(p, NO_STACK, 0);
+        spaces[space] = p;
+    }
+    return spaces[space];
+}
+
+void
+Profiler::SetSpace(unsigned space)
+{
+    current = GetSpace(space);
+}
+
+void
+Profiler::Grow(SpaceProfile *p, unsigned word)
+{
+    unsigned n = p->numWords * 2 > word ? p->numWords * 2 : word + 1;
+    unsigned long *runs      = new unsigned long [n];
+    unsigned long *entries   = new unsigned long [n];
+    unsigned long *blockRuns = new unsigned long [n];
+    for (unsigned i = 0; i < n; i++) {
+        bool old = i < p->numWords;
+        runs[i]      = old ? p->runs[i] : 0;
+        entries[i]   = old ? p->entries[i] : 0;
+        blockRuns[i] = old ? p->blockRuns[i] : 0;
+    }
+    delete [] p->runs;
+    delete [] p->entries;
+    delete [] p->blockRuns;
+    p->runs      = runs;
+    p->entries   = entries;
+    p->blockRuns = blockRuns;
+    p->numWords  = n;
+}
+
+/// Looking a call stack up by its parent and the function entered, rather
+/// than by its frames, takes constant time on every call and return.
+unsigned
+Profiler::FindStack(SpaceProfile *p, unsigned parent, unsigned pc)
+{
+    unsigned h = StackHash(parent, pc, p->maxStacks);
+    for (unsigned i = p->chains[h]; i != NO_STACK; i = p->stacks[i].next) {
+        const StackNode *s = &p->stacks[i];
+        if (s->parent == parent && s->pc == pc)
+            return i;
+    }
+
+    if (p->numStacks == p->maxStacks) {
+        GrowStacks(p);
+        h = StackHash(parent, pc, p->maxStacks);
+    }
+    StackNode *s = &p->stacks[p->numStacks];
+    s->parent = parent;
+    s->pc     = pc;
+    s->depth  = parent == NO_STACK ? 0 : p->stacks[parent].depth + 1;
+    s->count  = 0;
+    s->next   = p->chains[h];
+    p->chains[h] = p->numStacks;
+    return p->numStacks++;
+}
+
+/// There are as many hash chains as room for call stacks, so they stay
+/// short; they are all linked anew.
+void
+Profiler::GrowStacks(SpaceProfile *p)
+{
+    unsigned n = p->maxStacks == 0 ? 16 : p->maxStacks * 2;
+    StackNode *stacks = new StackNode [n];
+    unsigned *chains  = new unsigned [n];
+    for (unsigned i = 0; i < n; i++)
+        chains[i] = NO_STACK;
+    for (unsigned i = 0; i < p->numStacks; i++) {
+        stacks[i] = p->stacks[i];
+        unsigned h = StackHash(stacks[i].parent, stacks[i].pc, n);
+        stacks[i].next = chains[h];
+        chains[h] = i;
+    }
+    delete [] p->stacks;
+    delete [] p->chains;
+    p->stacks    = stacks;
+    p->chains    = chains;
+    p->maxStacks = n;
+}
+
+void
+Profiler::EnterBlock(SpaceProfile *p, unsigned pc)
+{
+    p->block = pc / 4;
+    p->entries[p->block]++;
+
+    if (p->calling) {
+        p->calling = false;
+        if (p->depth < MAX_PROFILE_DEPTH) {
+            p->depth++;
+            p->stack = FindStack(p, p->stack, pc);
+        } else
+            p->overflow++;
+    } else if (p->returning) {
+        p->returning = false;
+        // The outermost frame is never left.
+        if (p->overflow > 0)
+            p->overflow--;
+        else if (p->depth > 1) {
+            p->depth--;
+            p->stack = p->stacks[p->stack].parent;
+        }
+    }
+}
+
+/// Called by the machine before it runs each instruction.
+///
+/// An instruction that faults is run again once the kernel handled the
+/// fault; it is counted again, but does not begin a new block.
+void
+Profiler::Count(unsigned pc, const Instruction *instr)
+{
+    SpaceProfile *p = current;
+    if (p == nullptr)
+        return;
+
+    unsigned word = pc / 4;
+    if (word >= p->numWords)
+        Grow(p, word);
+    if (pc != p->expectedPc && pc + 4 != p->expectedPc)
+        EnterBlock(p, pc);
+    else if (p->calling && pc == p->linkPc)
+        p->calling = false;  // A conditional call was not taken.
+
+    p->runs[word]++;
+    p->blockRuns[p->block]++;
+    p->stacks[p->stack].count++;
+    p->total++;
+    p->expectedPc = pc + 4;
+
+    switch (instr->opCode) {
+        case OP_JAL:
+        case OP_JALR:
+        case OP_BGEZAL:
+        case OP_BLTZAL:
+            p->calling = true;
+            p->linkPc  = pc + 8;
+            break;
+        case OP_JR:
+            if (instr->rs == 31)
+                p->returning = true;
+            break;
+        default:
+            break;
+    }
+}
+
+void
+Profiler::Merge(const Profiler *other)
+{
+    ASSERT(other != nullptr);
+
+    for (unsigned i = 0; i < other->numSpaces; i++) {
+        const SpaceProfile *q = other->spaces[i];
+        if (q == nullptr)
+            continue;
+        SpaceProfile *p = GetSpace(i);
+        if (q->numWords > p->numWords)
+            Grow(p, q->numWords - 1);
+        for (unsigned w = 0; w < q->numWords; w++) {
+            p->runs[w]      += q->runs[w];
+            p->entries[w]   += q->entries[w];
+            p->blockRuns[w] += q->blockRuns[w];
+        }
+        p->total += q->total;
+
+        // A call stack comes after its parent, which is found first.
+        unsigned *found = new unsigned [q->numStacks];
+        for (unsigned j = 0; j < q->numStacks; j++) {
+            const StackNode *s = &q->stacks[j];
+            unsigned parent = s->parent == NO_STACK ? NO_STACK
+                                                    : found[s->parent];
+            found[j] = FindStack(p, parent, s->pc);
+            p->stacks[found[j]].count += s->count;
+        }
+        delete [] found;
+    }
+}
+
+/// Line of a report: an instruction word and its counts.
+struct ProfileLine {
+    unsigned word;
+    unsigned long count;
+    unsigned long entries;
+};
+
+static int
+CompareLines(const void *a, const void *b)
+{
+    const ProfileLine *x = (const ProfileLine *) a;
+    const ProfileLine *y = (const ProfileLine *) b;
+    if (x->count != y->count)
+        return x->count < y->count ? 1 : -1;
+    return x->word < y->word ? -1 : x->word > y->word;
+}
+
+/// Sort the non-zero `counts` into `lines`, hottest first; return how
+/// many there are.
+static unsigned
+SortLines(const unsigned long *counts, const unsigned long *entries,
+          unsigned numWords, ProfileLine *lines)
+{
+    unsigned n = 0;
+    for (unsigned w = 0; w < numWords; w++)
+        if (counts[w] > 0) {
+            lines[n].word    = w;
+            lines[n].count   = counts[w];
+            lines[n].entries = entries != nullptr ? entries[w] : 0;
+            n++;
+        }
+    qsort(lines, n, sizeof *lines, CompareLines);
+    return n;
+}
+
+void
+Profiler::PrintSpace(const SpaceProfile *p, unsigned space)
+{
+    printf("Profile of address space %u: %lu instructions\n",
+           space, p->total);
+
+    ProfileLine *lines = new ProfileLine [p->numWords];
+    unsigned n = SortLines(p->blockRuns, p->entries, p->numWords, lines);
+    printf("    Block       Entries  Instructions       %%\n");
+    for (unsigned i = 0; i < n && i < PROFILE_LINES; i++)
+        printf("    0x%08X %8lu %13lu %7.2f\n", lines[i].word * 4,
+               lines[i].entries, lines[i].count,
+               100.0 * lines[i].count / p->total);
+
+    n = SortLines(p->runs, nullptr, p->numWords, lines);
+    printf("    PC              Runs       %%\n");
+    for (unsigned i = 0; i < n && i < PROFILE_LINES; i++)
+        printf("    0x%08X %9lu %7.2f\n", lines[i].word * 4,
+               lines[i].count, 100.0 * lines[i].count / p->total);
+    delete [] lines;
+}
+
+void
+Profiler::Report() const
+{
+    for (unsigned i = 0; i < numSpaces; i++)
+        if (spaces[i] != nullptr && spaces[i]->total > 0)
+            PrintSpace(spaces[i], i);
+
+    if (foldedFile == nullptr)
+        return;
+
+    FILE *f = fopen(foldedFile, "w");
+    if (f == nullptr) {
+        fprintf(stderr, "Unable to write profile to `%s`.\n", foldedFile);
+        return;
+    }
+    for (unsigned i = 0; i < numSpaces; i++) {
+        const SpaceProfile *p = spaces[i];
+        if (p == nullptr)
+            continue;
+        for (unsigned j = 0; j < p->numStacks; j++) {
+            const StackNode *s = &p->stacks[j];
+            if (s->count == 0)
+                continue;
+            unsigned frames[MAX_PROFILE_DEPTH];
+            unsigned k = j;
+            for (unsigned d = s->depth; d > 0; d--) {
+                frames[d - 1] = p->stacks[k].pc;
+                k = p->stacks[k].parent;
+            }
+            fprintf(f, "space%u", i);
+            for (unsigned d = 0; d < s->depth; d++)
+                fprintf(f, ";0x%X", frames[d]);
+            fprintf(f, " %lu\n", s->count);
+        }
+    }
+    fclose(f);
+}
@@ -0,0 +1,104 @@
+/// Profiler of the user programs run by the machine.
+///
+/// For each address space, counts how many times each instruction is run,
+/// how many times each basic block is entered and how many instructions are
+/// run from it, and how many instructions are run under each call stack.
+///
+/// A block begins wherever control does not come from the instruction
+/// before, and goes on until control goes elsewhere, so a branch that is
+/// not taken does not end it.  Calls are told by `jal`, `jalr`, `bgezal`
+/// and `bltzal`, and returns by `jr $31`; each frame of a call stack is
+/// named by the address of the function entered.
+///
+/// Counting an instruction only takes a few increments, so that programs
+/// can be profiled at nearly full speed.
+///
+/// Copyright (c) 2016-2020 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+#ifndef NACHOS_MACHINE_PROFILER__HH
+#define NACHOS_MACHINE_PROFILER__HH
+
+
+#include "instruction.hh"
+
+
+/// Deepest call stack told apart; frames below are counted in the deepest
+/// one.
+const unsigned MAX_PROFILE_DEPTH = 64;
+
+/// Number of blocks and instructions listed for each address space.
+const unsigned PROFILE_LINES = 20;
+
+class Profiler {
+public:
+
+    /// Start with no counts.  If `foldedFile` is not null, `Report` also
+    /// writes the call stacks to that host file.
+    Profiler(const char *foldedFile);
+
+    ~Profiler();
+
+    /// Attribute the instructions run from now on to address space
+    /// `space`.
+    ///
+    /// The kernel must call this whenever it switches address spaces, and
+    /// never reuse a number for another address space.
+    void SetSpace(unsigned space);
+
+    /// Count a run of `instr`, found at `pc`.
+    void Count(unsigned pc, const Instruction *instr);
+
+    /// Add the counts of `other`, the profiler of another CPU.
+    void Merge(const Profiler *other);
+
+    /// Print the hottest blocks and instructions of each address space,
+    /// and write the call stacks, if asked for.
+    void Report() const;
+
+private:
+    struct SpaceProfile;
+
+    /// Instructions run under one call stack.  The call stacks seen form
+    /// a tree: each is its `parent` with a call to `pc` on top.
+    struct StackNode {
+        unsigned parent;
+        unsigned pc;
+        unsigned depth;
+        unsigned long count;
+        unsigned next;  ///< Next call stack in the same hash chain.
+    };
+
+    /// Where `Report` writes the call stacks, or null.
+    const char *foldedFile;
+
+    /// Profile of each address space, indexed by number.
+    SpaceProfile **spaces;
+    unsigned numSpaces;
+
+    /// Profile of the address space running.
+    SpaceProfile *current;
+
+    /// Return the profile of `space`, creating it if needed.
+    SpaceProfile *GetSpace(unsigned space);
+
+    /// Make room for the counts of instruction word `word`.
+    static void Grow(SpaceProfile *p, unsigned word);
+
+    /// Note that a block begins at `pc`.
+    static void EnterBlock(SpaceProfile *p, unsigned pc);
+
+    /// Return the index of the call stack `parent` with a call to `pc` on
+    /// top, adding one if needed.
+    static unsigned FindStack(SpaceProfile *p, unsigned parent, unsigned pc);
+
+    /// Make room for more call stacks.
+    static void GrowStacks(SpaceProfile *p);
+
+    /// Print the profile of address space `space`.
+    static void PrintSpace(const SpaceProfile *p, unsigned space);
+};
+
+
+#endif
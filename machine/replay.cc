@@ -0,0 +1,174 @@
+/// Copyright (c) 2016-2020 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+
+#include "replay.hh"
+#include "threads/system.hh"
+
+#include <stdio.h>
+#include <string.h>
+
+
+static const char REPLAY_MAGIC[8] = {
+    'N', 'A', 'C', 'H', 'R', 'P', 'L', '1'
+};
+
+Replay::Replay(const char *fileName, bool replaying_)
+{
+    ASSERT(fileName != nullptr);
+
+    replaying = replaying_;
+    lastWhen  = 0;
+    used      = 0;
+    filled    = 0;
+
+    if (!replaying) {
+        file = SystemDep::OpenForWrite(fileName);
+        SystemDep::WriteFile(file, REPLAY_MAGIC, sizeof REPLAY_MAGIC);
+        return;
+    }
+
+    file = SystemDep::OpenForReadWrite(fileName, false);
+    if (file < 0) {
+        fprintf(stderr, "Unable to open replay log %s\n", fileName);
+        ASSERT(false);
+    }
+    char magic[sizeof REPLAY_MAGIC];
+    if (SystemDep::ReadPartial(file, magic, sizeof magic) != (int) sizeof magic
+          || memcmp(magic, REPLAY_MAGIC, sizeof magic) != 0) {
+        fprintf(stderr, "%s is not a replay log\n", fileName);
+        ASSERT(false);
+    }
+}
+
+Replay::~Replay()
+{
+    if (!replaying)
+        Flush();
+    SystemDep::Close(file);
+}
+
+bool
+Replay::IsReplaying() const
+{
+    return replaying;
+}
+
+void
+Replay::PutByte(unsigned char c)
+{
+    if (used == REPLAY_BUFFER_SIZE)
+        Flush();
+    buffer[used++] = c;
+}
+
+void
+Replay::PutNumber(unsigned long n)
+{
+    while (n >= 0x80) {
+        PutByte((n & 0x7F) | 0x80);
+        n >>= 7;
+    }
+    PutByte(n);
+}
+
+void
+Replay::Flush()
+{
+    if (used == 0)
+        return;
+    SystemDep::WriteFile(file, buffer, used);
+    used = 0;
+}
+
+int
+Replay::PeekByte()
+{
+    if (used == filled) {
+        int n = SystemDep::ReadPartial(file, buffer, REPLAY_BUFFER_SIZE);
+        used   = 0;
+        filled = n > 0 ? n : 0;
+        if (filled == 0)
+            return -1;
+    }
+    return (unsigned char) buffer[used];
+}
+
+unsigned char
+Replay::GetByte()
+{
+    int c = PeekByte();
+    if (c < 0) {
+        fprintf(stderr, "The replay log ends too soon\n");
+        ASSERT(false);
+    }
+    used++;
+    return c;
+}
+
+unsigned long
+Replay::GetNumber()
+{
+    unsigned long n = 0;
+    unsigned char c;
+    unsigned shift = 0;
+    do {
+        c = GetByte();
+        n |= (unsigned long) (c & 0x7F) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    return n;
+}
+
+/// Ticks are logged as the distance from the interrupt before; they may
+/// go back, when the tick counter is restarted, and then the distance
+/// wraps around.
+bool
+Replay::Deliver(unsigned type, unsigned long when)
+{
+    ASSERT(type < REPLAY_INPUT);
+
+    unsigned long delta = when - lastWhen;
+    lastWhen = when;
+    if (!replaying) {
+        PutByte(type);
+        PutNumber(delta);
+        return true;
+    }
+
+    int tag = PeekByte();
+    if (tag < 0 || tag == REPLAY_INPUT)
+        return false;
+    used++;
+    return (unsigned) tag == type && GetNumber() == delta;
+}
+
+void
+Replay::Record(const char *data, unsigned length)
+{
+    ASSERT(data != nullptr);
+    ASSERT(length > 0);
+    ASSERT(!replaying);
+
+    PutByte(REPLAY_INPUT);
+    PutNumber(length);
+    for (unsigned i = 0; i < length; i++)
+        PutByte(data[i]);
+}
+
+unsigned
+Replay::Play(char *data, unsigned max)
+{
+    ASSERT(data != nullptr);
+    ASSERT(replaying);
+
+    if (PeekByte() != REPLAY_INPUT)
+        return 0;
+    used++;
+    unsigned length = GetNumber();
+    ASSERT(length > 0 && length <= max);
+    for (unsigned i = 0; i < length; i++)
+        data[i] = GetByte();
+    return length;
+}
@@ -0,0 +1,91 @@
+/// Record and replay of the timing of interrupts.
+///
+/// A run that reads the console or the network, or yields at random
+/// (`-rs`), depends on when the host happens to deliver its input, so two
+/// runs of the same program seldom match.  While recording, a `Replay`
+/// logs every interrupt delivered, with the tick it fired at, and whatever
+/// the device handling it took from the outside world: a console
+/// character, a network packet or a random timer delay.  While replaying,
+/// the devices take those from the log instead, so that the run is
+/// repeated exactly; an interrupt that does not fire at the tick the log
+/// says means that the runs diverged, and stops Nachos.
+///
+/// The log is a header followed by a stream of entries, each starting with
+/// a tag byte:
+///
+/// * an `IntType`, for an interrupt delivered, followed by the ticks since
+///   the one before;
+/// * `REPLAY_INPUT`, for input taken while handling the interrupt before,
+///   followed by its length and its bytes.
+///
+/// Numbers are written 7 bits at a time, low bits first, with the high bit
+/// set on every byte but the last, so that most entries take 2 or 3
+/// bytes.  Entries are written in blocks as the run goes, and a log cut
+/// short is still good up to where it ends.
+///
+/// Copyright (c) 2016-2020 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+#ifndef NACHOS_MACHINE_REPLAY__HH
+#define NACHOS_MACHINE_REPLAY__HH
+
+
+/// Bytes of the log buffered before writing them, or read ahead.
+const unsigned REPLAY_BUFFER_SIZE = 4096;
+
+/// Tag of an input entry; interrupt entries are tagged by their type.
+const unsigned char REPLAY_INPUT = 0x80;
+
+class Replay {
+public:
+
+    /// Start recording to host file `fileName`, or replaying from it if
+    /// `replaying` is set.
+    Replay(const char *fileName, bool replaying);
+
+    /// Write out the entries still buffered, and close the file.
+    ~Replay();
+
+    /// Whether the devices must take their input from the log.
+    bool IsReplaying() const;
+
+    /// Note that an interrupt of type `type` fires at tick `when`.
+    ///
+    /// When replaying, returns false if the log has some other interrupt
+    /// next.
+    bool Deliver(unsigned type, unsigned long when);
+
+    /// Log `length` bytes of input, taken from the host.
+    void Record(const char *data, unsigned length);
+
+    /// Copy into `data` the input taken at this point of the recorded
+    /// run, of at most `max` bytes.
+    ///
+    /// Returns its length, or 0 if there was none.
+    unsigned Play(char *data, unsigned max);
+
+private:
+
+    int file;
+    bool replaying;
+
+    /// Tick of the interrupt delivered last.
+    unsigned long lastWhen;
+
+    char buffer[REPLAY_BUFFER_SIZE];
+    unsigned used;    ///< Bytes of `buffer` written, or already read.
+    unsigned filled;  ///< Bytes of `buffer` read from the file.
+
+    void PutByte(unsigned char c);
+    void PutNumber(unsigned long n);
+    void Flush();
+
+    /// Return the next byte of the log, or -1 at its end.
+    int PeekByte();
+    unsigned char GetByte();
+    unsigned long GetNumber();
+};
+
+
+#endif
@@ -18,9 +18,15 @@
 Statistics::Statistics()
 {
     totalTicks = idleTicks = systemTicks = userTicks = 0;
+    userInstructions = stallTicks = 0;
     numDiskReads = numDiskWrites = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPageHits =numPacketsSent = numPacketsRecvd = 0;
+    numTlbHits = numTlbMisses = numTlbRefills = numTlbWalks = 0;
+    numTlbPrefetches = 0;
+    numICacheHits = numICacheMisses = 0;
+    numDCacheHits = numDCacheMisses = numMemoryWrites = 0;
+    numRealTimeJobs = numDeadlineMisses = numAdmissionsRefused = 0;
 #ifdef DFS_TICKS_FIX
     tickResets = 0;
 #endif
@@ -39,11 +45,37 @@ Statistics::Print()
 #endif
     printf("Ticks: total %lu, idle %lu, system %lu, user %lu\n",
            totalTicks, idleTicks, systemTicks, userTicks);
+#ifdef USER_PROGRAM
+    printf("User code: instructions %lu, stall ticks %lu\n",
+           userInstructions, stallTicks);
+#endif
     printf("Disk I/O: reads %lu, writes %lu\n", numDiskReads, numDiskWrites);
     printf("Console I/O: reads %lu, writes %lu\n",
            numConsoleCharsRead, numConsoleCharsWritten);
     printf("Paging: faults %lu\n", numPageFaults);
+#ifdef USE_TLB
+    printf("TLB: hits %lu, misses %lu, refills %lu, walks %lu,"
+           " prefetches %lu\n", numTlbHits, numTlbMisses, numTlbRefills,
+           numTlbWalks, numTlbPrefetches);
+#endif
+#ifdef USER_PROGRAM
+    // Only with caches, which are off by default.
+    if (numICacheHits + numICacheMisses > 0)
+        printf("Instruction cache: hits %lu, misses %lu, hit rate %.2f%%\n",
+               numICacheHits, numICacheMisses,
+               100.0 * numICacheHits / (numICacheHits + numICacheMisses));
+    if (numDCacheHits + numDCacheMisses > 0)
+        printf("Data cache: hits %lu, misses %lu, hit rate %.2f%%,"
+               " memory writes %lu\n", numDCacheHits, numDCacheMisses,
+               100.0 * numDCacheHits / (numDCacheHits + numDCacheMisses),
+               numMemoryWrites);
+#endif
     printf("Network I/O: packets received %lu, sent %lu\n",
            numPacketsRecvd, numPacketsSent);
+    // Only with real-time threads.
+    if (numRealTimeJobs + numAdmissionsRefused > 0)
+        printf("Real time: jobs %lu, deadline misses %lu,"
+               " reservations refused %lu\n", numRealTimeJobs,
+               numDeadlineMisses, numAdmissionsRefused);
     printf("Page Faults: %lu\nPage Succesful Hits: %lu\n",numPageFaults,numPageHits-numPageFaults);
 }
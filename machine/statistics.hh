@@ -28,10 +28,17 @@ public:
     /// Time spent executing system code.
     unsigned long systemTicks;
 
-    /// Time spent executing user code (this is also equal to # of user
-    /// instructions executed).
+    /// Time spent executing user code, stalls included (with the default
+    /// cost model, this is also equal to # of user instructions executed).
     unsigned long userTicks;
 
+    /// Number of user instructions executed.
+    unsigned long userInstructions;
+
+    /// Part of `userTicks` spent stalled on TLB refills, page faults and
+    /// cache misses.
+    unsigned long stallTicks;
+
     /// Number of disk read requests.
     unsigned long numDiskReads;
 
@@ -50,12 +57,49 @@ public:
     /// Number of virtual memory page hits.
     unsigned long numPageHits;
 
+    /// Number of translations found in the TLB.
+    unsigned long numTlbHits;
+
+    /// Number of translations not found in the TLB.
+    unsigned long numTlbMisses;
+
+    /// Number of entries loaded into the TLB.
+    unsigned long numTlbRefills;
+
+    /// Number of TLB misses refilled by the page table walker, without
+    /// trapping to the kernel.
+    unsigned long numTlbWalks;
+
+    /// Number of entries loaded into the TLB ahead of a miss.
+    unsigned long numTlbPrefetches;
+
+    /// Number of instruction fetches that hit and missed in the
+    /// instruction cache.
+    unsigned long numICacheHits;
+    unsigned long numICacheMisses;
+
+    /// Number of data references that hit and missed in the data cache.
+    unsigned long numDCacheHits;
+    unsigned long numDCacheMisses;
+
+    /// Number of writes from the data cache to memory.
+    unsigned long numMemoryWrites;
+
     /// Number of packets sent over the network.
     unsigned long numPacketsSent;
 
     /// Number of packets received over the network.
     unsigned long numPacketsRecvd;
 
+    /// Number of periods begun by real-time threads, and of those missed:
+    /// the thread was still running or ready at the deadline, or blocked
+    /// only after it.
+    unsigned long numRealTimeJobs;
+    unsigned long numDeadlineMisses;
+
+    /// Number of real-time reservations refused, for lack of CPU time.
+    unsigned long numAdmissionsRefused;
+
 #ifdef DFS_TICKS_FIX
     /// Number of times the tick count gets reset.
     unsigned long tickResets;
@@ -200,6 +200,30 @@ Unlink(const char *name)
     return unlink(name);
 }
 
+/// Map `nBytes` of anonymous memory, filled with zeros.
+///
+/// Abort on error.
+void *
+MapZeroed(size_t nBytes)
+{
+    ASSERT(nBytes > 0);
+    void *address = mmap(nullptr, nBytes, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    ASSERT(address != MAP_FAILED);
+    return address;
+}
+
+/// Unmap memory mapped by `MapZeroed`.
+///
+/// Abort on error.
+void
+Unmap(void *address, size_t nBytes)
+{
+    ASSERT(address != nullptr);
+    int retVal = munmap(address, nBytes);
+    ASSERT(retVal == 0);
+}
+
 /// Open an interprocess communication (IPC) connection.
 ///
 /// For now, just open a datagram port where other Nachos (simulating
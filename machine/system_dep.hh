@@ -45,6 +45,15 @@ namespace SystemDep {
 
     bool Unlink(const char *name);
 
+    /// Memory operations: map and unmap zero-filled memory, whose pages the
+    /// host only commits once they are touched.
+    ///
+    /// For simulating main memory.
+
+    void *MapZeroed(size_t nBytes);
+
+    void Unmap(void *address, size_t nBytes);
+
     /// Interprocess communication operations, for simulating the network.
 
     int OpenSocket();
@@ -0,0 +1,709 @@
+/// Threaded-code engine for simulating the MIPS processor.
+///
+/// `Machine::ExecInstruction` remains the reference interpreter: it goes
+/// through a big `switch` for every instruction it runs.  This engine
+/// instead gives each kind of instruction its own handler routine, which is
+/// resolved once when the instruction is decoded (see
+/// `Instruction::Decode`).  A basic block is then just the sequence of
+/// handlers stored in the decode cache, and it is run by calling them one
+/// after the other, with no further dispatch.
+///
+/// A block is left as soon as control does not flow to the next
+/// instruction, an exception is raised, or an interrupt is delivered; in
+/// any of those cases the machine state may have changed, and the next
+/// block is fetched from scratch.
+///
+/// Every handler must behave exactly as the corresponding case in
+/// `ExecInstruction`.
+///
+/// Copyright (c) 2016-2020 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+
+#include "instruction.hh"
+#include "machine.hh"
+#include "threads/system.hh"
+
+
+/// Run a user program, one basic block at a time.
+///
+/// Called by `Machine::Run`; never returns.  Simulated time advances exactly
+/// as with the reference interpreter: the ticks of each instruction are
+/// charged through `Tick`.
+void
+Machine::RunThreaded()
+{
+    for (;;) {
+        const Instruction *block;
+        unsigned length, physAddr;
+        ExceptionType e = mmu.FetchBlock(registers[PC_REG], &block,
+                                         &length, &physAddr);
+        if (e != NO_EXCEPTION) {
+            RaiseException(e, registers[PC_REG]);
+            Tick(USER_TICK, false);
+            continue;
+        }
+
+        // Only the first instruction of the block is translated.  The
+        // fetches of the others would all hit the TLB, so count them as
+        // such, to keep the statistics equal to the interpreter's.
+        // The instruction cache must still see every fetch.
+        unsigned long fetchHit = mmu.tlb != nullptr ? 1 : 0;
+        bool instrCache = mmu.HasInstructionCache();
+
+        unsigned long generation = mmu.GetDecodeGeneration();
+        int pc = registers[PC_REG];
+        for (unsigned i = 0; i < length; i++) {
+            if (profiler != nullptr)
+                profiler->Count(pc, &block[i]);
+            unsigned long ticks = costModel.instruction[block[i].opCode];
+            bool retired = (*block[i].handler)(this, registers, &block[i]);
+            bool interrupted = Tick(retired ? ticks : USER_TICK, retired);
+            pc += 4;
+            if (!retired || interrupted || registers[PC_REG] != pc
+                  || mmu.GetDecodeGeneration() != generation)
+                break;
+            if (i + 1 < length) {
+                stats->numTlbHits += fetchHit;
+                if (instrCache)
+                    mmu.FetchFromBlock(physAddr + 4 * (i + 1));
+            }
+        }
+    }
+}
+
+/// Finish an instruction: do any delayed load and advance the program
+/// counters, as at the end of `ExecInstruction`.
+static inline bool
+Retire(int *r, int nextLoadReg, int nextLoadValue, int pcAfter)
+{
+    r[r[LOAD_REG]] = r[LOAD_VALUE_REG];
+    r[LOAD_REG] = nextLoadReg;
+    r[LOAD_VALUE_REG] = nextLoadValue;
+    r[0] = 0;
+
+    r[PREV_PC_REG] = r[PC_REG];
+    r[PC_REG] = r[NEXT_PC_REG];
+    r[NEXT_PC_REG] = pcAfter;
+    return true;
+}
+
+/// Retire an instruction that neither loads nor branches.
+static inline bool
+Retire(int *r)
+{
+    return Retire(r, 0, 0, r[NEXT_PC_REG] + 4);
+}
+
+/// Retire a taken or not taken conditional branch.
+static inline bool
+RetireBranch(int *r, bool taken, const Instruction *instr)
+{
+    int pcAfter = taken ? r[NEXT_PC_REG] + IndexToAddr(instr->extra)
+                        : r[NEXT_PC_REG] + 4;
+    return Retire(r, 0, 0, pcAfter);
+}
+
+// Arithmetic and logic.
+
+static bool
+ExecAdd(Machine *m, int *r, const Instruction *instr)
+{
+    int sum;
+    if (AddOverflows(r[instr->rs], r[instr->rt], &sum)) {
+        m->RaiseException(OVERFLOW_EXCEPTION, 0);
+        return false;
+    }
+    r[instr->rd] = sum;
+    return Retire(r);
+}
+
+static bool
+ExecAddi(Machine *m, int *r, const Instruction *instr)
+{
+    int sum;
+    if (AddOverflows(r[instr->rs], instr->extra, &sum)) {
+        m->RaiseException(OVERFLOW_EXCEPTION, 0);
+        return false;
+    }
+    r[instr->rt] = sum;
+    return Retire(r);
+}
+
+static bool
+ExecAddiu(Machine *m, int *r, const Instruction *instr)
+{
+    r[instr->rt] = r[instr->rs] + instr->extra;
+    return Retire(r);
+}
+
+static bool
+ExecAddu(Machine *m, int *r, const Instruction *instr)
+{
+    r[instr->rd] = r[instr->rs] + r[instr->rt];
+    return Retire(r);
+}
+
+static bool
+ExecAnd(Machine *m, int *r, const Instruction *instr)
+{
+    r[instr->rd] = r[instr->rs] & r[instr->rt];
+    return Retire(r);
+}
+
+static bool
+ExecAndi(Machine *m, int *r, const Instruction *instr)
+{
+    r[instr->rt] = r[instr->rs] & (instr->extra & 0xFFFF);
+    return Retire(r);
+}
+
+static bool
+ExecNor(Machine *m, int *r, const Instruction *instr)
+{
+    r[instr->rd] = ~(r[instr->rs] | r[instr->rt]);
+    return Retire(r);
+}
+
+static bool
+ExecOr(Machine *m, int *r, const Instruction *instr)
+{
+    r[instr->rd] = r[instr->rs] | r[instr->rt];
+    return Retire(r);
+}
+
+static bool
+ExecOri(Machine *m, int *r, const Instruction *instr)
+{
+    r[instr->rt] = r[instr->rs] | (instr->extra & 0xFFFF);
+    return Retire(r);
+}
+
+static bool
+ExecXor(Machine *m, int *r, const Instruction *instr)
+{
+    r[instr->rd] = r[instr->rs] ^ r[instr->rt];
+    return Retire(r);
+}
+
+static bool
+ExecXori(Machine *m, int *r, const Instruction *instr)
+{
+    r[instr->rt] = r[instr->rs] ^ (instr->extra & 0xFFFF);
+    return Retire(r);
+}
+
+static bool
+ExecLui(Machine *m, int *r, const Instruction *instr)
+{
+    r[instr->rt] = instr->extra << 16;
+    return Retire(r);
+}
+
+static bool
+ExecSub(Machine *m, int *r, const Instruction *instr)
+{
+    int diff;
+    if (SubOverflows(r[instr->rs], r[instr->rt], &diff)) {
+        m->RaiseException(OVERFLOW_EXCEPTION, 0);
+        return false;
+    }
+    r[instr->rd] = diff;
+    return Retire(r);
+}
+
+static bool
+ExecSubu(Machine *m, int *r, const Instruction *instr)
+{
+    r[instr->rd] = r[instr->rs] - r[instr->rt];
+    return Retire(r);
+}
+
+static bool
+ExecSlt(Machine *m, int *r, const Instruction *instr)
+{
+    r[instr->rd] = r[instr->rs] < r[instr->rt] ? 1 : 0;
+    return Retire(r);
+}
+
+static bool
+ExecSlti(Machine *m, int *r, const Instruction *instr)
+{
+    r[instr->rt] = r[instr->rs] < instr->extra ? 1 : 0;
+    return Retire(r);
+}
+
+static bool
+ExecSltiu(Machine *m, int *r, const Instruction *instr)
+{
+    unsigned rs = r[instr->rs];
+    unsigned imm = instr->extra;
+    r[instr->rt] = rs < imm ? 1 : 0;
+    return Retire(r);
+}
+
+static bool
+ExecSltu(Machine *m, int *r, const Instruction *instr)
+{
+    unsigned rs = r[instr->rs];
+    unsigned rt = r[instr->rt];
+    r[instr->rd] = rs < rt ? 1 : 0;
+    return Retire(r);
+}
+
+// Shifts.
+
+static bool
+ExecSll(Machine *m, int *r, const Instruction *instr)
+{
+    r[instr->rd] = r[instr->rt] << instr->extra;
+    return Retire(r);
+}
+
+static bool
+ExecSllv(Machine *m, int *r, const Instruction *instr)
+{
+    r[instr->rd] = r[instr->rt] << (r[instr->rs] & 0x1F);
+    return Retire(r);
+}
+
+static bool
+ExecSra(Machine *m, int *r, const Instruction *instr)
+{
+    r[instr->rd] = r[instr->rt] >> instr->extra;
+    return Retire(r);
+}
+
+static bool
+ExecSrav(Machine *m, int *r, const Instruction *instr)
+{
+    r[instr->rd] = r[instr->rt] >> (r[instr->rs] & 0x1F);
+    return Retire(r);
+}
+
+// NOTE: like the reference interpreter, logical right shifts are done on a
+// signed temporary.
+static bool
+ExecSrl(Machine *m, int *r, const Instruction *instr)
+{
+    int tmp = r[instr->rt];
+    tmp >>= instr->extra;
+    r[instr->rd] = tmp;
+    return Retire(r);
+}
+
+static bool
+ExecSrlv(Machine *m, int *r, const Instruction *instr)
+{
+    int tmp = r[instr->rt];
+    tmp >>= r[instr->rs] & 0x1F;
+    r[instr->rd] = tmp;
+    return Retire(r);
+}
+
+// Multiplication and division.
+
+static bool
+ExecMult(Machine *m, int *r, const Instruction *instr)
+{
+    Mult(r[instr->rs], r[instr->rt], true, &r[HI_REG], &r[LO_REG]);
+    return Retire(r);
+}
+
+static bool
+ExecMultu(Machine *m, int *r, const Instruction *instr)
+{
+    Mult(r[instr->rs], r[instr->rt], false, &r[HI_REG], &r[LO_REG]);
+    return Retire(r);
+}
+
+static bool
+ExecDiv(Machine *m, int *r, const Instruction *instr)
+{
+    Div(r[instr->rs], r[instr->rt], true, &r[HI_REG], &r[LO_REG]);
+    return Retire(r);
+}
+
+static bool
+ExecDivu(Machine *m, int *r, const Instruction *instr)
+{
+    Div(r[instr->rs], r[instr->rt], false, &r[HI_REG], &r[LO_REG]);
+    return Retire(r);
+}
+
+static bool
+ExecMfhi(Machine *m, int *r, const Instruction *instr)
+{
+    r[instr->rd] = r[HI_REG];
+    return Retire(r);
+}
+
+static bool
+ExecMflo(Machine *m, int *r, const Instruction *instr)
+{
+    r[instr->rd] = r[LO_REG];
+    return Retire(r);
+}
+
+static bool
+ExecMthi(Machine *m, int *r, const Instruction *instr)
+{
+    r[HI_REG] = r[instr->rs];
+    return Retire(r);
+}
+
+static bool
+ExecMtlo(Machine *m, int *r, const Instruction *instr)
+{
+    r[LO_REG] = r[instr->rs];
+    return Retire(r);
+}
+
+// Branches and jumps.
+
+static bool
+ExecBeq(Machine *m, int *r, const Instruction *instr)
+{
+    return RetireBranch(r, r[instr->rs] == r[instr->rt], instr);
+}
+
+static bool
+ExecBne(Machine *m, int *r, const Instruction *instr)
+{
+    return RetireBranch(r, r[instr->rs] != r[instr->rt], instr);
+}
+
+static bool
+ExecBgez(Machine *m, int *r, const Instruction *instr)
+{
+    return RetireBranch(r, !(r[instr->rs] & SIGN_BIT), instr);
+}
+
+static bool
+ExecBgezal(Machine *m, int *r, const Instruction *instr)
+{
+    r[RET_ADDR_REG] = r[NEXT_PC_REG] + 4;
+    return RetireBranch(r, !(r[instr->rs] & SIGN_BIT), instr);
+}
+
+static bool
+ExecBgtz(Machine *m, int *r, const Instruction *instr)
+{
+    return RetireBranch(r, r[instr->rs] > 0, instr);
+}
+
+static bool
+ExecBlez(Machine *m, int *r, const Instruction *instr)
+{
+    return RetireBranch(r, r[instr->rs] <= 0, instr);
+}
+
+static bool
+ExecBltz(Machine *m, int *r, const Instruction *instr)
+{
+    return RetireBranch(r, r[instr->rs] & SIGN_BIT, instr);
+}
+
+static bool
+ExecBltzal(Machine *m, int *r, const Instruction *instr)
+{
+    r[RET_ADDR_REG] = r[NEXT_PC_REG] + 4;
+    return RetireBranch(r, r[instr->rs] & SIGN_BIT, instr);
+}
+
+static bool
+ExecJ(Machine *m, int *r, const Instruction *instr)
+{
+    int pcAfter = r[NEXT_PC_REG] + 4;
+    return Retire(r, 0, 0,
+                  (pcAfter & 0xF0000000) | IndexToAddr(instr->extra));
+}
+
+static bool
+ExecJal(Machine *m, int *r, const Instruction *instr)
+{
+    r[RET_ADDR_REG] = r[NEXT_PC_REG] + 4;
+    return ExecJ(m, r, instr);
+}
+
+static bool
+ExecJr(Machine *m, int *r, const Instruction *instr)
+{
+    return Retire(r, 0, 0, r[instr->rs]);
+}
+
+static bool
+ExecJalr(Machine *m, int *r, const Instruction *instr)
+{
+    r[instr->rd] = r[NEXT_PC_REG] + 4;
+    return ExecJr(m, r, instr);
+}
+
+// Loads.
+
+static bool
+ExecLb(Machine *m, int *r, const Instruction *instr)
+{
+    int value;
+    if (!m->ReadMem(r[instr->rs] + instr->extra, 1, &value))
+        return false;
+    if (value & 0x80)
+        value |= 0xFFFFFF00;
+    else
+        value &= 0xFF;
+    return Retire(r, instr->rt, value, r[NEXT_PC_REG] + 4);
+}
+
+static bool
+ExecLbu(Machine *m, int *r, const Instruction *instr)
+{
+    int value;
+    if (!m->ReadMem(r[instr->rs] + instr->extra, 1, &value))
+        return false;
+    return Retire(r, instr->rt, value & 0xFF, r[NEXT_PC_REG] + 4);
+}
+
+static bool
+ExecLh(Machine *m, int *r, const Instruction *instr)
+{
+    int addr = r[instr->rs] + instr->extra;
+    if (addr & 0x1) {
+        m->RaiseException(ADDRESS_ERROR_EXCEPTION, addr);
+        return false;
+    }
+    int value;
+    if (!m->ReadMem(addr, 2, &value))
+        return false;
+    if (value & 0x8000)
+        value |= 0xFFFF0000;
+    else
+        value &= 0xFFFF;
+    return Retire(r, instr->rt, value, r[NEXT_PC_REG] + 4);
+}
+
+static bool
+ExecLhu(Machine *m, int *r, const Instruction *instr)
+{
+    int addr = r[instr->rs] + instr->extra;
+    if (addr & 0x1) {
+        m->RaiseException(ADDRESS_ERROR_EXCEPTION, addr);
+        return false;
+    }
+    int value;
+    if (!m->ReadMem(addr, 2, &value))
+        return false;
+    return Retire(r, instr->rt, value & 0xFFFF, r[NEXT_PC_REG] + 4);
+}
+
+static bool
+ExecLw(Machine *m, int *r, const Instruction *instr)
+{
+    int addr = r[instr->rs] + instr->extra;
+    if (addr & 0x3) {
+        m->RaiseException(ADDRESS_ERROR_EXCEPTION, addr);
+        return false;
+    }
+    int value;
+    if (!m->ReadMem(addr, 4, &value))
+        return false;
+    return Retire(r, instr->rt, value, r[NEXT_PC_REG] + 4);
+}
+
+static bool
+ExecLwl(Machine *m, int *r, const Instruction *instr)
+{
+    int addr = r[instr->rs] + instr->extra;
+
+    // `ReadMem` assumes all 4 byte requests are aligned on an even word
+    // boundary, see `ExecInstruction`.
+    ASSERT((addr & 0x3) == 0);
+
+    int value;
+    if (!m->ReadMem(addr, 4, &value))
+        return false;
+
+    int nextLoadValue = r[LOAD_REG] == instr->rt ? r[LOAD_VALUE_REG]
+                                                 : r[instr->rt];
+    switch (addr & 0x3) {
+        case 0:
+            nextLoadValue = value;
+            break;
+        case 1:
+            nextLoadValue = (nextLoadValue & 0xFF) | value << 8;
+            break;
+        case 2:
+            nextLoadValue = (nextLoadValue & 0xFFFF) | value << 16;
+            break;
+        case 3:
+            nextLoadValue = (nextLoadValue & 0xFFFFFF) | value << 24;
+            break;
+    }
+    return Retire(r, instr->rt, nextLoadValue, r[NEXT_PC_REG] + 4);
+}
+
+static bool
+ExecLwr(Machine *m, int *r, const Instruction *instr)
+{
+    int addr = r[instr->rs] + instr->extra;
+
+    // `ReadMem` assumes all 4 byte requests are aligned on an even word
+    // boundary, see `ExecInstruction`.
+    ASSERT((addr & 0x3) == 0);
+
+    int value;
+    if (!m->ReadMem(addr, 4, &value))
+        return false;
+
+    int nextLoadValue = r[LOAD_REG] == instr->rt ? r[LOAD_VALUE_REG]
+                                                 : r[instr->rt];
+    switch (addr & 0x3) {
+        case 0:
+            nextLoadValue = (nextLoadValue & 0xFFFFFF00)
+                            | (value >> 24 & 0xFF);
+            break;
+        case 1:
+            nextLoadValue = (nextLoadValue & 0xFFFF0000)
+                            | (value >> 16 & 0xFFFF);
+            break;
+        case 2:
+            nextLoadValue = (nextLoadValue & 0xFF000000)
+                            | (value >> 8 & 0xFFFFFF);
+            break;
+        case 3:
+            nextLoadValue = value;
+            break;
+    }
+    return Retire(r, instr->rt, nextLoadValue, r[NEXT_PC_REG] + 4);
+}
+
+// Stores.
+
+static bool
+ExecSb(Machine *m, int *r, const Instruction *instr)
+{
+    if (!m->WriteMem((unsigned) (r[instr->rs] + instr->extra),
+                     1, r[instr->rt]))
+        return false;
+    return Retire(r);
+}
+
+static bool
+ExecSh(Machine *m, int *r, const Instruction *instr)
+{
+    if (!m->WriteMem((unsigned) (r[instr->rs] + instr->extra),
+                     2, r[instr->rt]))
+        return false;
+    return Retire(r);
+}
+
+static bool
+ExecSw(Machine *m, int *r, const Instruction *instr)
+{
+    if (!m->WriteMem((unsigned) (r[instr->rs] + instr->extra),
+                     4, r[instr->rt]))
+        return false;
+    return Retire(r);
+}
+
+static bool
+ExecSwl(Machine *m, int *r, const Instruction *instr)
+{
+    int addr = r[instr->rs] + instr->extra;
+
+    // See `ExecInstruction`.
+    ASSERT((addr & 0x3) == 0);
+
+    int value;
+    if (!m->ReadMem(addr & ~0x3, 4, &value))
+        return false;
+    switch (addr & 0x3) {
+        case 0:
+            value = r[instr->rt];
+            break;
+        case 1:
+            value = (value & 0xFF000000) | (r[instr->rt] >> 8 & 0xFFFFFF);
+            break;
+        case 2:
+            value = (value & 0xFFFF0000) | (r[instr->rt] >> 16 & 0xFFFF);
+            break;
+        case 3:
+            value = (value & 0xFFFFFF00) | (r[instr->rt] >> 24 & 0xFF);
+            break;
+    }
+    if (!m->WriteMem(addr & ~0x3, 4, value))
+        return false;
+    return Retire(r);
+}
+
+static bool
+ExecSwr(Machine *m, int *r, const Instruction *instr)
+{
+    int addr = r[instr->rs] + instr->extra;
+
+    // See `ExecInstruction`.
+    ASSERT((addr & 0x3) == 0);
+
+    int value;
+    if (!m->ReadMem(addr & ~0x3, 4, &value))
+        return false;
+    switch (addr & 0x3) {
+        case 0:
+            value = (value & 0xFFFFFF) | r[instr->rt] << 24;
+            break;
+        case 1:
+            value = (value & 0xFFFF) | r[instr->rt] << 16;
+            break;
+        case 2:
+            value = (value & 0xFF) | r[instr->rt] << 8;
+            break;
+        case 3:
+            value = r[instr->rt];
+            break;
+    }
+    if (!m->WriteMem(addr & ~0x3, 4, value))
+        return false;
+    return Retire(r);
+}
+
+// Traps.
+
+static bool
+ExecSyscall(Machine *m, int *r, const Instruction *instr)
+{
+    m->RaiseException(SYSCALL_EXCEPTION, 0);
+    return false;
+}
+
+static bool
+ExecIllegal(Machine *m, int *r, const Instruction *instr)
+{
+    m->RaiseException(ILLEGAL_INSTR_EXCEPTION, 0);
+    return false;
+}
+
+static bool
+ExecBad(Machine *m, int *r, const Instruction *instr)
+{
+    ASSERT(false);
+    return false;
+}
+
+const InstructionHandler INSTRUCTION_HANDLERS[MAX_OPCODE + 1] = {
+    ExecBad,     ExecAdd,     ExecAddi,    ExecAddiu,    //  0 -  3
+    ExecAddu,    ExecAnd,     ExecAndi,    ExecBeq,      //  4 -  7
+    ExecBgez,    ExecBgezal,  ExecBgtz,    ExecBlez,     //  8 - 11
+    ExecBltz,    ExecBltzal,  ExecBne,     ExecBad,      // 12 - 15
+    ExecDiv,     ExecDivu,    ExecJ,       ExecJal,      // 16 - 19
+    ExecJalr,    ExecJr,      ExecLb,      ExecLbu,      // 20 - 23
+    ExecLh,      ExecLhu,     ExecLui,     ExecLw,       // 24 - 27
+    ExecLwl,     ExecLwr,     ExecBad,     ExecMfhi,     // 28 - 31
+    ExecMflo,    ExecBad,     ExecMthi,    ExecMtlo,     // 32 - 35
+    ExecMult,    ExecMultu,   ExecNor,     ExecOr,       // 36 - 39
+    ExecOri,     ExecBad,     ExecSb,      ExecSh,       // 40 - 43
+    ExecSll,     ExecSllv,    ExecSlt,     ExecSlti,     // 44 - 47
+    ExecSltiu,   ExecSltu,    ExecSra,     ExecSrav,     // 48 - 51
+    ExecSrl,     ExecSrlv,    ExecSub,     ExecSubu,     // 52 - 55
+    ExecSw,      ExecSwl,     ExecSwr,     ExecXor,      // 56 - 59
+    ExecXori,    ExecSyscall, ExecIllegal, ExecIllegal   // 60 - 63
+};
@@ -73,8 +73,20 @@ Timer::TimerExpired()
 int
 Timer::TimeOfNextInterrupt()
 {
-    if (randomize)
-        return 1 + SystemDep::Random() % (TIMER_TICKS * 2);
-    else
+    if (!randomize)
         return TIMER_TICKS;
+
+    // Random delays are logged, so that replaying does not depend on what
+    // else draws random numbers.
+    Replay *replay = interrupt->GetReplay();
+    int delay;
+    if (replay != nullptr && replay->IsReplaying()) {
+        unsigned n = replay->Play((char *) &delay, sizeof delay);
+        ASSERT(n == sizeof delay);
+    } else {
+        delay = 1 + SystemDep::Random() % (TIMER_TICKS * 2);
+        if (replay != nullptr)
+            replay->Record((const char *) &delay, sizeof delay);
+    }
+    return delay;
 }
@@ -53,6 +53,13 @@ public:
 
     /// This bit is set by the hardware every time the page is modified.
     bool dirty;
+
+    /// Address space identifier the entry belongs to.
+    ///
+    /// Only meaningful in the TLB, where it is set by the hardware when the
+    /// entry is loaded: an entry only matches while the MMU runs with the
+    /// same identifier.
+    unsigned asid;
 };
 
 
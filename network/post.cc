@@ -19,6 +19,7 @@
 
 
 #include "post.hh"
+#include "threads/system.hh"
 
 #include <stdio.h>
 #include <string.h>
@@ -188,8 +189,10 @@ PostOffice::PostOffice(NetworkAddress addr, double reliability, int nBoxes)
     network = new Network(addr, reliability, ReadAvail, WriteDone, this);
 
     // Finally, create a thread whose sole job is to wait for incoming
-    // messages, and put them in the right mailbox.
+    // messages, and put them in the right mailbox.  It delivers them ahead
+    // of the other threads, unless the reservation is refused.
     Thread *t = new Thread("postal worker", false, 0);
+    scheduler->SetRealTime(t, POSTAL_PERIOD, POSTAL_BUDGET);
 
     t->Fork(PostalHelper, this);
 }
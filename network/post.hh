@@ -28,6 +28,7 @@
 
 
 #include "network.hh"
+#include "machine/statistics.hh"
 #include "threads/synch_list.hh"
 
 
@@ -52,6 +53,11 @@ public:
 /// Excluding the `MailHeader` and the `PacketHeader`.
 const unsigned MAX_MAIL_SIZE = MAX_PACKET_SIZE - sizeof (MailHeader);
 
+/// Real-time reservation of the postal worker: the ticks it may take in
+/// every period to deliver mail, ahead of the other threads.
+const unsigned long POSTAL_PERIOD = 10 * NETWORK_TIME;
+const unsigned long POSTAL_BUDGET = 2 * NETWORK_TIME;
+
 /// The following class defines the format of an incoming/outgoing `Mail`
 /// message.
 ///
@@ -11,7 +11,18 @@
 /// =====
 ///
 ///     nachos [-d <debugflags>] [-p] [-rs <random seed #>] [-z]
-///            [-s] [-x <nachos file>] [-tc <consoleIn> <consoleOut>]
+///            [-sched <priority|mlfq|stride|cfs>]
+///            [-record <unix file>] [-replay <unix file>]
+///            [-s] [-dt] [-smp <cpus>] [-prof]
+///            [-proffolded <unix file>] [-trace <unix file>]
+///            [-costs <unix file>] [-mem <bytes>[K|M]]
+///            [-icache <bytes>:<line bytes>:<ways>]
+///            [-dcache <bytes>:<line bytes>:<ways>[:wb|:wt]]
+///            [-tlbsize <entries>]
+///            [-tlbways <entries per set>] [-tlbwalk]
+///            [-tlbpolicy <fifo|random|nru|lru>] [-tlbprefetch]
+///            [-checkpoint <unix file>] [-x <nachos file>]
+///            [-restore <unix file>] [-tc <consoleIn> <consoleOut>] [-tm]
 ///            [-f] [-cp <unix file> <nachos file>] [-pr <nachos file>]
 ///            [-rm <nachos file>] [-ls] [-D] [-c] [-tf]
 ///            [-n <network reliability>] [-id <machine id>]
@@ -24,14 +35,73 @@
 ///   `utility.hh`).
 /// * `-p`  -- enables preemptive multitasking for kernel threads.
 /// * `-rs` -- causes `Yield` to occur at random (but repeatable) spots.
+/// * `-sched` -- chooses how threads are scheduled: by strict priority (the
+///   default), or by a multi-level feedback queue, which demotes threads
+///   that keep running for a while, raises back those that wait for the
+///   disk or the console, and every thread once in a while, or by stride
+///   scheduling, which shares the CPU among threads in proportion to the
+///   tickets they hold (see the `SetTickets` system call), or completely
+///   fairly, running the thread that ran the least, weighted by priority,
+///   for a slice that shrinks as more threads are ready.  Other than the
+///   default, it time slices threads with the timer, at fixed intervals
+///   unless `-rs` is given, and prints the ticks each thread ran and waited
+///   when the machine halts.
 /// * `-z`  -- prints version and copyright information, and exits.
+/// * `-record` -- logs every interrupt delivered, and the console input,
+///   network packets and random timer delays taken, to a file.
+/// * `-replay` -- repeats the run logged by `-record`, given the same
+///   other flags, taking that input from the log instead of the host; stops
+///   if the run diverges.  Neither works with `-p` or `-smp`.
 ///
 /// *USER_PROGRAM* options
 /// ----------------------
 ///
 /// * `-s`  -- causes user programs to be executed in single-step mode.
+/// * `-dt` -- runs user programs with the threaded-code engine instead of
+///   the reference interpreter.
+/// * `-smp` -- simulates a machine with several CPUs, each driven by a host
+///   thread of its own (not with *USE_TLB*, nor with `-s` or `-p`).
+/// * `-prof` -- counts the instructions run by user programs, and prints
+///   their hottest blocks and instructions when the machine halts.
+/// * `-proffolded` -- like `-prof`, and also writes the instructions run
+///   under each call stack to a file, folded as flame graph tools take them.
+/// * `-trace` -- writes every memory reference of user programs to a file,
+///   in binary; `bin/readtrace` prints it.  With `-smp`, each CPU other than
+///   the first writes to the file name followed by its number.
+/// * `-costs` -- reads the ticks each kind of user instruction takes, and
+///   those an instruction stalls for on a TLB refill, a page fault, a cache
+///   miss or a write to memory, from a file with lines like `mult 12`,
+///   `div 35`, `tlbrefill 20`, `pagefault 5000`, `cachemiss 10` or
+///   `memorywrite 10`.  By default every instruction takes one tick, and
+///   nothing stalls.
+/// * `-mem` -- sets the size of main memory, rounded up to whole pages, up
+///   to 1 GB; by default it has 64 pages.  Frames take up host memory only
+///   once used.
+/// * `-icache`, `-dcache` -- simulate a level 1 cache of instructions or of
+///   data, of the given size (which may end in `K`), line size and
+///   associativity, all powers of two; the data cache writes back (`wb`,
+///   the default) or through (`wt`).  Their hit rates are printed when the
+///   machine halts, and misses stall for as long as the `cachemiss` and
+///   `memorywrite` costs say.
+/// * `-tlbsize` -- sets the number of TLB entries (only with *USE_TLB*).
+/// * `-tlbways` -- sets the TLB associativity, at least 2 (only with
+///   *USE_TLB*); by default the TLB is fully associative.
+/// * `-tlbwalk` -- refills the TLB from the page table in hardware, trapping
+///   to the kernel only for pages not in memory (only with *USE_TLB*).
+/// * `-tlbpolicy` -- chooses how TLB entries are replaced: round robin (the
+///   default), at random, not recently used or least recently used (only
+///   with *USE_TLB*).
+/// * `-tlbprefetch` -- also loads the translation of the next page on a TLB
+///   miss (only with *USE_TLB*).
+/// * `-checkpoint` -- saves a checkpoint of the user program run by a later
+///   `-x`, right before it starts.
 /// * `-x`  -- runs a user program.
+/// * `-restore` -- runs a user program from a checkpoint, skipping its
+///   loading and whatever the kernel did before.
 /// * `-tc` -- tests the console.
+/// * `-tm` -- checks the multiplication, division and overflow checked
+///   arithmetic of the simulated CPU against reference routines, over a
+///   million random pairs of operands.
 ///
 /// *FILESYS* options
 /// -----------------
@@ -83,8 +153,10 @@ void Copy(const char *unixFile, const char *nachosFile);
 void Print(const char *file);
 void PerformanceTest(void);
 void Tests(void);
-void StartProcess(const char *file);
+void StartProcess(const char *file, const char *checkpoint);
+void RestoreProcess(const char *checkpoint);
 void ConsoleTest(const char *in, const char *out);
+void ArithmeticTest(unsigned n);
 void MailTest(int networkID);
 
 static inline void
@@ -110,6 +182,9 @@ int
 main(int argc, char **argv)
 {
     int argCount;  // The number of arguments for a particular command.
+#ifdef USER_PROGRAM
+    const char *checkpoint = nullptr;  // Where to checkpoint `-x`.
+#endif
 
     Initialize(argc, argv);
     DEBUG('t', "Entering main\n");
@@ -121,9 +196,17 @@ main(int argc, char **argv)
             return 0;
         }
 #ifdef USER_PROGRAM
-        if (!strcmp(*argv, "-x")) {          // Run a user program.
+        if (!strcmp(*argv, "-checkpoint")) {  // Checkpoint the next
+            ASSERT(argc > 1);                 // user program.
+            checkpoint = *(argv + 1);
+            argCount = 2;
+        } else if (!strcmp(*argv, "-x")) {   // Run a user program.
             ASSERT(argc > 1);
-            StartProcess(*(argv + 1));
+            StartProcess(*(argv + 1), checkpoint);
+            argCount = 2;
+        } else if (!strcmp(*argv, "-restore")) {  // Run a user program
+            ASSERT(argc > 1);                     // from a checkpoint.
+            RestoreProcess(*(argv + 1));
             argCount = 2;
         } else if (!strcmp(*argv, "-tc")) {  // Test the console.
             if (argc == 1)
@@ -136,6 +219,9 @@ main(int argc, char **argv)
             interrupt->Halt();  // Once we start the console, then Nachos
                                 // will loop forever waiting for console
                                 // input.
+        } else if (!strcmp(*argv, "-tm")) {  // Test the arithmetic.
+            ArithmeticTest(1000000);
+            interrupt->Halt();
         }
 #endif
 #ifdef FILESYS
@@ -152,10 +152,14 @@ ContextSwitch(void)
 
     inContextSwitch = true;
 
-    // Make a context switch if interrupts are enabled.
+    // Make a context switch if interrupts are enabled, and the scheduler
+    // does not give the thread a longer slice than the monitor's.  With
+    // interrupts disabled, the scheduler may be halfway through changing
+    // its queues; `Interrupt::OneTick` asks it once they are enabled.
     if (interrupt->GetLevel() == INT_ON) {
         inContextSwitch = false;
-        currentThread->Yield();
+        if (scheduler->SliceExpired())
+            currentThread->Yield();
     } else {
         interrupt->YieldOnReturn();
         inContextSwitch = false;
@@ -9,8 +9,17 @@
 /// needed to wait for a lock, and the lock was busy, we would end up calling
 /// `FindNextToRun`, and that would put us in an infinite loop.
 ///
-/// Very simple implementation -- no priorities, straight FIFO.  Might need
-/// to be improved in later assignments.
+/// Threads are run by priority, in FIFO order within a priority.  Under the
+/// multi-level feedback queue policy, a thread runs at its priority plus the
+/// levels it was demoted for running long.  Under stride scheduling,
+/// threads are instead kept in a heap by pass, and the one with the least
+/// pass runs next; under completely fair scheduling, they are kept in a
+/// balanced tree by virtual runtime, and the one leftmost runs next.
+///
+/// Whatever the policy, threads holding a real-time reservation run first,
+/// the one with the earliest deadline, as long as they have budget left in
+/// their period; past it, they wait for the next, and only run meanwhile if
+/// no other thread is ready.
 ///
 /// Copyright (c) 1992-1993 The Regents of the University of California.
 ///               2016-2020 Docentes de la Universidad Nacional de Rosario.
@@ -22,23 +31,186 @@
 #include "system.hh"
 
 #include <stdio.h>
+#include <string.h>
+
 
+/// Weight of each priority under completely fair scheduling.
+static const unsigned CFS_WEIGHTS[NUM_PRIORITIES] = {
+    CFS_WEIGHT_0, 819, 655, 524, 419, 336, 268, 215, 172, 137, 110, 88, 70,
+    56, 45, 36, 29, 23, 18, 15, 12, 9, 8, 6, 5, 4, 3, 2, 2, 2, 1, 1
+};
 
-/// Initialize the list of ready but not running threads to empty.
-Scheduler::Scheduler()
+/// Initialize the queues of ready but not running threads to empty.
+Scheduler::Scheduler(SchedulerPolicy policy_)
 {
-    readyList = new List<Thread *>;
+    numCpus     = interrupt->GetNumCpus();
+    nextCpu     = 0;
+    policy      = policy_;
+    boostEpoch  = 0;
+    nextBoost   = MLFQ_BOOST_PERIOD;
+    passQueue   = new Heap<Thread *> [numCpus];
+    cpuPass     = new unsigned long [numCpus];
+    cfsTree     = new Thread * [numCpus];
+    cfsLoad     = new unsigned long [numCpus];
+    cpuVruntime = new unsigned long [numCpus];
+    rtQueue     = new Heap<Thread *> [numCpus];
+    rtThrottled = new Heap<Thread *> [numCpus];
+    rtUtilization = new unsigned [numCpus];
+    usage       = nullptr;
+    numUsage    = 0;
+    maxUsage    = 0;
+    readyList   = new ReadyQueue [numCpus];
+    for (unsigned i = 0; i < numCpus; i++) {
+        for (unsigned p = 0; p < NUM_PRIORITIES; p++) {
+            readyList[i].first[p] = nullptr;
+            readyList[i].last[p]  = nullptr;
+        }
+        readyList[i].nonEmpty = 0;
+        cpuPass[i]     = 0;
+        cfsTree[i]     = nullptr;
+        cfsLoad[i]     = 0;
+        cpuVruntime[i] = 0;
+        rtUtilization[i] = 0;
+    }
 }
 
-/// De-allocate the list of ready threads.
+/// De-allocate the queues of ready threads.
 Scheduler::~Scheduler()
 {
-    delete readyList;
+    delete [] readyList;
+    delete [] passQueue;
+    delete [] cpuPass;
+    delete [] cfsTree;
+    delete [] cfsLoad;
+    delete [] cpuVruntime;
+    delete [] rtQueue;
+    delete [] rtThrottled;
+    delete [] rtUtilization;
+    for (unsigned i = 0; i < numUsage; i++)
+        delete [] usage[i].name;
+    delete [] usage;
+}
+
+void
+Scheduler::Enqueue(Thread *thread, int prio)
+{
+    ASSERT(thread->readyPrio == -1);
+    ASSERT(0 <= prio && prio < (int) NUM_PRIORITIES);
+
+    ReadyQueue *q = &readyList[thread->GetCpu()];
+    thread->readyPrev = q->last[prio];
+    thread->readyNext = nullptr;
+    thread->readyPrio = prio;
+    if (q->last[prio] != nullptr)
+        q->last[prio]->readyNext = thread;
+    else
+        q->first[prio] = thread;
+    q->last[prio] = thread;
+    q->nonEmpty |= 1U << prio;
+}
+
+void
+Scheduler::Dequeue(Thread *thread)
+{
+    ASSERT(thread->readyPrio != -1);
+
+    ReadyQueue *q = &readyList[thread->GetCpu()];
+    int prio = thread->readyPrio;
+    if (thread->readyPrev != nullptr)
+        thread->readyPrev->readyNext = thread->readyNext;
+    else
+        q->first[prio] = thread->readyNext;
+    if (thread->readyNext != nullptr)
+        thread->readyNext->readyPrev = thread->readyPrev;
+    else
+        q->last[prio] = thread->readyPrev;
+    if (q->first[prio] == nullptr)
+        q->nonEmpty &= ~(1U << prio);
+    thread->readyPrev = nullptr;
+    thread->readyNext = nullptr;
+    thread->readyPrio = -1;
+}
+
+int
+Scheduler::QueuePriority(Thread *thread)
+{
+    int prio = thread->GetPriority();
+    if (policy != SCHED_MLFQ)
+        return prio;
+
+    if (thread->boostEpoch != boostEpoch) {  // Boosted since demoted.
+        thread->boostEpoch = boostEpoch;
+        thread->level      = 0;
+        thread->levelTicks = 0;
+    }
+    prio += thread->level;
+    return prio < (int) NUM_PRIORITIES ? prio : NUM_PRIORITIES - 1;
+}
+
+void
+Scheduler::AddUsage(Thread *thread)
+{
+    if (thread->usage != -1)
+        return;
+
+    if (numUsage == maxUsage) {
+        unsigned n = maxUsage == 0 ? 16 : maxUsage * 2;
+        ThreadUsage *u = new ThreadUsage [n];
+        for (unsigned i = 0; i < numUsage; i++)
+            u[i] = usage[i];
+        delete [] usage;
+        usage    = u;
+        maxUsage = n;
+    }
+
+    // The name of a thread may not outlive it.
+    ThreadUsage *u = &usage[numUsage];
+    u->name = new char [strlen(thread->GetName()) + 1];
+    strcpy(u->name, thread->GetName());
+    u->tickets     = thread->tickets;
+    u->ticks       = 0;
+    u->waited      = 0;
+    u->longestWait = 0;
+    thread->usage = numUsage++;
+}
+
+void
+Scheduler::Charge(Thread *thread)
+{
+    unsigned long ran = stats->totalTicks - thread->dispatchTick;
+    thread->dispatchTick = stats->totalTicks;
+    thread->rtUsed += ran;
+    if (policy == SCHED_PRIORITY)
+        return;  // There is no report of usage to keep.
+
+    AddUsage(thread);
+    usage[thread->usage].ticks += ran;
+    if (policy == SCHED_STRIDE)
+        thread->pass += ran * (STRIDE_ONE / thread->tickets);
+    else if (policy == SCHED_CFS)
+        thread->vruntime += ran * CFS_WEIGHT_0
+                              / CFS_WEIGHTS[thread->GetPriority()];
+    if (policy != SCHED_MLFQ)
+        return;
+
+    QueuePriority(thread);  // Forget levels from before a boost.
+    thread->levelTicks += ran;
+    if (thread->levelTicks >= MLFQ_ALLOTMENT) {
+        thread->levelTicks = 0;
+        if (thread->level < MLFQ_LEVELS - 1) {
+            thread->level++;
+            DEBUG('t', "Demoting thread %s to level %u\n",
+                  thread->GetName(), thread->level);
+        }
+    }
 }
 
 /// Mark a thread as ready, but not running.
 /// Put it on the ready list, for later scheduling onto the CPU.
 ///
+/// A thread that was never ready before is assigned a CPU first, and the
+/// CPU is woken up if it was idle.
+///
 /// * `thread` is the thread to be put on the ready list.
 void
 Scheduler::ReadyToRun(Thread *thread)
@@ -47,22 +219,110 @@ Scheduler::ReadyToRun(Thread *thread)
 
     DEBUG('t', "Putting thread %s on ready list\n", thread->GetName());
 
-    thread->SetStatus(READY);
-    //readyList->Append(thread);
-    readyList->SortedInsert(thread,thread->GetPriority());
+    if (thread->GetCpu() == NO_CPU) {
+        thread->SetCpu(nextCpu);
+        nextCpu = (nextCpu + 1) % numCpus;
+    }
+    if (thread->status == RUNNING)  // Yielding; it is charged now, so that
+        Charge(thread);             // it is queued at its new level.
+    else if (thread->status == JUST_CREATED && policy != SCHED_PRIORITY)
+        AddUsage(thread);  // While its name is sure to be valid.
+
+    thread->readyTick = stats->totalTicks;
+
+    // A real-time thread starts a new period once the last one is over.
+    // If it did not wait for anything since, it missed the deadline.
+    if (thread->rtPeriod != 0 && PeriodOver(thread))
+        StartPeriod(thread, thread->status == RUNNING);
+
+    unsigned cpu = thread->GetCpu();
+    if (HasBudget(thread)) {
+        thread->SetStatus(READY);
+        rtQueue[cpu].Insert(thread, thread->rtDeadline);
+        // Take the CPU from a thread that should not keep it, at the next
+        // tick.
+        if (cpu == interrupt->GetCpu() && currentThread != thread
+              && (!HasBudget(currentThread)
+                  || thread->rtDeadline < currentThread->rtDeadline))
+            interrupt->YieldOnReturn();
+    } else if (thread->rtPeriod != 0) {  // Out of budget until its deadline.
+        thread->SetStatus(READY);
+        rtThrottled[cpu].Insert(thread, thread->rtDeadline);
+    } else if (policy == SCHED_STRIDE) {
+        // A thread that was not running does not keep the lead it took
+        // while away.
+        if (thread->status != RUNNING && thread->pass < cpuPass[cpu])
+            thread->pass = cpuPass[cpu];
+        thread->SetStatus(READY);
+        passQueue[cpu].Insert(thread, thread->pass);
+    } else if (policy == SCHED_CFS) {
+        ASSERT(thread->treeHeight == 0);  // Not in the tree already.
+        if (thread->status != RUNNING && thread->vruntime < cpuVruntime[cpu])
+            thread->vruntime = cpuVruntime[cpu];
+        thread->SetStatus(READY);
+        thread->treeWeight = CFS_WEIGHTS[thread->GetPriority()];
+        cfsLoad[cpu] += thread->treeWeight;
+        cfsTree[cpu] = TreeInsert(cfsTree[cpu], thread);
+    } else {
+        thread->SetStatus(READY);
+        Enqueue(thread, QueuePriority(thread));
+    }
+    interrupt->WakeCpu(thread->GetCpu());
 }
 
-/// Return the next thread to be scheduled onto the CPU.
+/// Return the next thread to be scheduled onto the current CPU.
 ///
 /// If there are no ready threads, return null.
 ///
+/// Real-time threads with budget left come first, by deadline.  Otherwise,
+/// the highest priority with ready threads is the lowest bit set in the
+/// bitmap of the CPU's queues.  Real-time threads out of budget come last.
+///
 /// Side effect: thread is removed from the ready list.
 Thread *
 Scheduler::FindNextToRun() // ----- SE CAMBIO EL ORDEN DE LAS PRIORIDADES, 0 ES LA PRIORIDAD MAS ALTA ----
 {
-    //return readyList->Pop();
-    int p;
-    return readyList->SortedPop(&p);
+    Thread *thread = PickNext();
+    // A real-time thread that was still ready at its deadline missed it.
+    if (thread != nullptr && thread->rtPeriod != 0 && PeriodOver(thread))
+        StartPeriod(thread, true);
+    return thread;
+}
+
+Thread *
+Scheduler::PickNext()
+{
+    unsigned cpu = interrupt->GetCpu();
+    Replenish(cpu);  // There may be no timer to do it.
+    Thread *rtThread = rtQueue[cpu].Pop(nullptr);
+    if (rtThread != nullptr)
+        return rtThread;
+    if (policy == SCHED_STRIDE) {
+        unsigned long pass;
+        Thread *thread = passQueue[cpu].Pop(&pass);
+        if (thread != nullptr) {
+            cpuPass[cpu] = pass;
+            return thread;
+        }
+    } else if (policy == SCHED_CFS) {
+        if (cfsTree[cpu] != nullptr) {
+            Thread *thread;
+            cfsTree[cpu] = TreeRemoveFirst(cfsTree[cpu], &thread);
+            thread->treeHeight = 0;  // Out of the tree.
+            cfsLoad[cpu] -= thread->treeWeight;
+            cpuVruntime[cpu] = thread->vruntime;
+            return thread;
+        }
+    } else {
+        ReadyQueue *q = &readyList[cpu];
+        if (q->nonEmpty != 0) {
+            Thread *thread = q->first[__builtin_ctz(q->nonEmpty)];
+            Dequeue(thread);
+            return thread;
+        }
+    }
+    // Rather than leave the CPU idle.
+    return rtThrottled[cpu].Pop(nullptr);
 }
 
 /// Dispatch the CPU to `nextThread`.
@@ -93,6 +353,22 @@ Scheduler::Run(Thread *nextThread)
 
     oldThread->CheckOverflow();  // Check if the old thread had an undetected
                                  // stack overflow.
+    Charge(oldThread);
+    if (oldThread->status == BLOCKED && oldThread->rtPeriod != 0
+          && PeriodOver(oldThread)) {
+        // It blocked too late; the next period starts when it wakes up.
+        DEBUG('t', "Thread %s missed its deadline\n", oldThread->GetName());
+        stats->numDeadlineMisses++;
+    }
+    nextThread->dispatchTick = stats->totalTicks;
+    if (policy != SCHED_PRIORITY) {
+        AddUsage(nextThread);
+        ThreadUsage *u = &usage[nextThread->usage];
+        unsigned long waited = stats->totalTicks - nextThread->readyTick;
+        u->waited += waited;
+        if (waited > u->longestWait)
+            u->longestWait = waited;
+    }
 
     currentThread = nextThread;  // Switch to the next thread.
     currentThread->SetStatus(RUNNING);  // `nextThread` is now running.
@@ -128,7 +404,7 @@ Scheduler::Run(Thread *nextThread)
 }
 
 /// Print the scheduler state -- in other words, the contents of the ready
-/// list.
+/// list, highest priority first.
 ///
 /// For debugging.
 static void
@@ -141,14 +417,321 @@ ThreadPrint(Thread *t)
 void
 Scheduler::Print()
 {
-    printf("Ready list contents:\n");
-    readyList->Apply(ThreadPrint);
+    for (unsigned i = 0; i < numCpus; i++) {
+        if (numCpus == 1)
+            printf("Ready list contents:\n");
+        else
+            printf("Ready list contents of CPU %u:\n", i);
+        rtQueue[i].Apply(ThreadPrint);
+        rtThrottled[i].Apply(ThreadPrint);
+        passQueue[i].Apply(ThreadPrint);
+        TreeApply(cfsTree[i], ThreadPrint);
+        for (unsigned p = 0; p < NUM_PRIORITIES; p++)
+            for (Thread *t = readyList[i].first[p]; t != nullptr;
+                 t = t->readyNext)
+                t->Print();
+    }
 }
 
+/// Move `owner` to the queue of its new priority, at the end, if it is
+/// ready.
+///
+/// Called by `Lock` when priorities are donated, without interrupts
+/// disabled, so it disables them itself.
 void 
 Scheduler::ChangePriority(Thread *owner) { // owner ya tiene la prioridad cambiada
-    if(readyList->Has(owner)){
-        readyList->Remove(owner);
-        readyList->SortedInsert(owner, owner->GetPriority());
+    // Priorities do not matter under stride scheduling.  Under CFS, the
+    // new weight applies from the next charge, and the thread keeps its
+    // place.
+    if (policy == SCHED_STRIDE || policy == SCHED_CFS)
+        return;
+    IntStatus oldLevel = interrupt->SetLevel(INT_OFF);
+    if (owner->readyPrio != -1 && owner->readyPrio != QueuePriority(owner)) {
+        Dequeue(owner);
+        Enqueue(owner, QueuePriority(owner));
+    }
+    interrupt->SetLevel(oldLevel);
+}
+
+/// Threads that are not ready are boosted lazily, by the change of
+/// `boostEpoch`, when they are next queued or charged.
+void
+Scheduler::CheckBoost()
+{
+    if (policy != SCHED_MLFQ || stats->totalTicks < nextBoost)
+        return;
+
+    DEBUG('t', "Boosting every thread back to its priority\n");
+    nextBoost = stats->totalTicks + MLFQ_BOOST_PERIOD;
+    boostEpoch++;
+
+    // Threads only move to queues of higher priority, which were already
+    // gone through.
+    for (unsigned i = 0; i < numCpus; i++)
+        for (unsigned p = 0; p < NUM_PRIORITIES; p++) {
+            Thread *next;
+            for (Thread *t = readyList[i].first[p]; t != nullptr; t = next) {
+                next = t->readyNext;
+                int prio = QueuePriority(t);
+                if (prio != t->readyPrio) {
+                    Dequeue(t);
+                    Enqueue(t, prio);
+                }
+            }
+        }
+}
+
+void
+Scheduler::CheckPeriods()
+{
+    for (unsigned i = 0; i < numCpus; i++)
+        Replenish(i);
+}
+
+void
+Scheduler::BoostForIo(Thread *thread)
+{
+    ASSERT(thread != nullptr);
+
+    if (policy != SCHED_MLFQ)
+        return;
+    IntStatus oldLevel = interrupt->SetLevel(INT_OFF);
+    Charge(thread);  // At the level it ran at.
+    thread->level      = 0;
+    thread->levelTicks = 0;
+    interrupt->SetLevel(oldLevel);
+}
+
+/// A thread keeps its pass; its new share only changes how fast the pass
+/// grows from now on.
+void
+Scheduler::SetTickets(Thread *thread, unsigned tickets)
+{
+    ASSERT(thread != nullptr);
+    ASSERT(tickets >= 1 && tickets <= MAX_TICKETS);
+
+    IntStatus oldLevel = interrupt->SetLevel(INT_OFF);
+    Charge(thread);  // At the old share.
+    thread->tickets = tickets;
+    if (thread->usage != -1)
+        usage[thread->usage].tickets = tickets;
+    interrupt->SetLevel(oldLevel);
+}
+
+/// The thousandths of the CPU a reservation takes are rounded up, so that
+/// the reservations admitted never add up to more than they seem to.
+bool
+Scheduler::SetRealTime(Thread *thread, unsigned long period,
+                       unsigned long budget)
+{
+    ASSERT(thread != nullptr);
+    ASSERT(thread->status != READY);  // Not queued by its old class.
+    ASSERT(budget <= period);
+    ASSERT(period == 0 || budget > 0);
+
+    IntStatus oldLevel = interrupt->SetLevel(INT_OFF);
+    if (thread->GetCpu() == NO_CPU) {
+        thread->SetCpu(nextCpu);
+        nextCpu = (nextCpu + 1) % numCpus;
+    }
+    unsigned cpu = thread->GetCpu();
+    unsigned before = thread->rtPeriod == 0 ? 0
+      : (thread->rtBudget * 1000 + thread->rtPeriod - 1) / thread->rtPeriod;
+    unsigned after = period == 0 ? 0 : (budget * 1000 + period - 1) / period;
+    if (rtUtilization[cpu] - before + after > RT_MAX_UTILIZATION) {
+        DEBUG('t', "Refusing a reservation of %lu ticks every %lu to %s\n",
+              budget, period, thread->GetName());
+        stats->numAdmissionsRefused++;
+        interrupt->SetLevel(oldLevel);
+        return false;
+    }
+
+    if (thread->status == RUNNING)
+        Charge(thread);  // Under its old reservation.
+    rtUtilization[cpu] += after - before;
+    thread->rtPeriod   = period;
+    thread->rtBudget   = budget;
+    thread->rtDeadline = stats->totalTicks + period;
+    thread->rtUsed     = 0;
+    if (period != 0)
+        stats->numRealTimeJobs++;
+    interrupt->SetLevel(oldLevel);
+    return true;
+}
+
+void
+Scheduler::PrintUsage()
+{
+    if (policy == SCHED_PRIORITY)
+        return;
+
+    Charge(currentThread);
+    printf("Ticks run and waited by thread:\n");
+    for (unsigned i = 0; i < numUsage; i++) {
+        printf("    %-16s ran %10lu, waited %10lu, longest wait %8lu",
+               usage[i].name, usage[i].ticks, usage[i].waited,
+               usage[i].longestWait);
+        if (policy == SCHED_STRIDE)
+            printf(", tickets %u", usage[i].tickets);
+        printf("\n");
     }
 }
+
+/// The slice of a thread is its share, by weight, of `CFS_LATENCY`, but no
+/// less than `CFS_MIN_GRANULARITY`.
+bool
+Scheduler::SliceExpired()
+{
+    unsigned cpu = interrupt->GetCpu();
+    unsigned long deadline;
+    bool rtReady = rtQueue[cpu].Head(&deadline) != nullptr;
+    if (HasBudget(currentThread)) {
+        unsigned long ran = stats->totalTicks - currentThread->dispatchTick;
+        return currentThread->rtUsed + ran >= currentThread->rtBudget
+               || (rtReady && deadline < currentThread->rtDeadline);
+    }
+    // A real-time thread out of budget only runs while no other is ready.
+    if (rtReady || policy != SCHED_CFS || currentThread->rtPeriod != 0)
+        return true;
+
+    if (cfsTree[cpu] == nullptr)
+        return false;
+    unsigned long weight = CFS_WEIGHTS[currentThread->GetPriority()];
+    unsigned long slice  = CFS_LATENCY * weight / (cfsLoad[cpu] + weight);
+    if (slice < CFS_MIN_GRANULARITY)
+        slice = CFS_MIN_GRANULARITY;
+    return stats->totalTicks - currentThread->dispatchTick >= slice;
+}
+
+void
+Scheduler::StartPeriod(Thread *thread, bool missed)
+{
+    if (missed) {
+        DEBUG('t', "Thread %s missed its deadline\n", thread->GetName());
+        stats->numDeadlineMisses++;
+    }
+    thread->rtDeadline = stats->totalTicks + thread->rtPeriod;
+    thread->rtUsed     = 0;
+    stats->numRealTimeJobs++;
+}
+
+/// The period of a thread covers the ticks before its deadline; a thread
+/// still wanting to run at the deadline has missed it.
+bool
+Scheduler::PeriodOver(const Thread *thread)
+{
+    return stats->totalTicks >= thread->rtDeadline;
+}
+
+/// A thread still ready at the end of its period has not finished the job
+/// of that period, and missed its deadline.
+void
+Scheduler::Replenish(unsigned cpu)
+{
+    unsigned long deadline;
+    while (rtThrottled[cpu].Head(&deadline) != nullptr
+             && stats->totalTicks >= deadline) {
+        Thread *thread = rtThrottled[cpu].Pop(nullptr);
+        StartPeriod(thread, true);
+        rtQueue[cpu].Insert(thread, thread->rtDeadline);
+    }
+}
+
+bool
+Scheduler::HasBudget(const Thread *thread)
+{
+    return thread->rtPeriod != 0 && thread->rtUsed < thread->rtBudget;
+}
+
+int
+Scheduler::TreeHeight(Thread *root)
+{
+    return root != nullptr ? root->treeHeight : 0;
+}
+
+Thread *
+Scheduler::TreeRotate(Thread *root, bool left)
+{
+    Thread *child = left ? root->treeRight : root->treeLeft;
+    if (left) {
+        root->treeRight = child->treeLeft;
+        child->treeLeft = root;
+    } else {
+        root->treeLeft   = child->treeRight;
+        child->treeRight = root;
+    }
+    // Only the heights change; the first rotation of a double one may
+    // leave `child` unbalanced until the second.
+    TreeResize(root);
+    TreeResize(child);
+    return child;
+}
+
+void
+Scheduler::TreeResize(Thread *root)
+{
+    int hl = TreeHeight(root->treeLeft), hr = TreeHeight(root->treeRight);
+    root->treeHeight = 1 + (hl > hr ? hl : hr);
+}
+
+/// Update the height of `root`, and rotate it if its subtrees differ in
+/// height by more than one.
+Thread *
+Scheduler::TreeBalance(Thread *root)
+{
+    Thread *l = root->treeLeft, *r = root->treeRight;
+    int hl = TreeHeight(l), hr = TreeHeight(r);
+    TreeResize(root);
+
+    if (hl > hr + 1) {
+        if (TreeHeight(l->treeLeft) < TreeHeight(l->treeRight))
+            root->treeLeft = TreeRotate(l, true);
+        return TreeRotate(root, false);
+    }
+    if (hr > hl + 1) {
+        if (TreeHeight(r->treeRight) < TreeHeight(r->treeLeft))
+            root->treeRight = TreeRotate(r, false);
+        return TreeRotate(root, true);
+    }
+    return root;
+}
+
+/// Threads of equal virtual runtime go right of each other, so that they
+/// come out in the order they were queued.
+Thread *
+Scheduler::TreeInsert(Thread *root, Thread *thread)
+{
+    if (root == nullptr) {
+        thread->treeLeft   = nullptr;
+        thread->treeRight  = nullptr;
+        thread->treeHeight = 1;
+        return thread;
+    }
+    if (thread->vruntime < root->vruntime)
+        root->treeLeft = TreeInsert(root->treeLeft, thread);
+    else
+        root->treeRight = TreeInsert(root->treeRight, thread);
+    return TreeBalance(root);
+}
+
+Thread *
+Scheduler::TreeRemoveFirst(Thread *root, Thread **first)
+{
+    if (root->treeLeft == nullptr) {
+        *first = root;
+        return root->treeRight;
+    }
+    root->treeLeft = TreeRemoveFirst(root->treeLeft, first);
+    return TreeBalance(root);
+}
+
+/// Apply `func` to the threads of a tree, in order.
+void
+Scheduler::TreeApply(Thread *root, void (*func)(Thread *))
+{
+    if (root == nullptr)
+        return;
+    TreeApply(root->treeLeft, func);
+    func(root);
+    TreeApply(root->treeRight, func);
+}
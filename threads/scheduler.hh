@@ -1,6 +1,6 @@
 /// Data structures for the thread dispatcher and scheduler.
 ///
-/// Primarily, the list of threads that are ready to run.
+/// Primarily, the queues of threads that are ready to run.
 ///
 /// Copyright (c) 1992-1993 The Regents of the University of California.
 ///               2016-2020 Docentes de la Universidad Nacional de Rosario.
@@ -12,8 +12,75 @@
 
 
 #include "thread.hh"
-#include "lib/list.hh"
+#include "lib/heap.hh"
+#include "machine/statistics.hh"
+
+
+/// Ways of choosing the next thread to run.
+enum SchedulerPolicy {
+    SCHED_PRIORITY,  ///< Strict priorities, changed only by donation.
+    SCHED_MLFQ,      ///< Multi-level feedback queue: threads that run for
+                     ///< long are demoted below their priority, threads
+                     ///< waiting for devices and every thread once in a
+                     ///< while are raised back to it.
+    SCHED_STRIDE,    ///< Stride scheduling: threads share the CPU in
+                     ///< proportion to their tickets, regardless of
+                     ///< priority.
+    SCHED_CFS        ///< Completely fair scheduling: the thread that ran
+                     ///< the least, weighted by its priority, runs next,
+                     ///< for a slice that shrinks as more threads are
+                     ///< ready.
+};
+
+/// Ticks a thread may run at a level of the multi-level feedback queue,
+/// over any number of turns, before it is demoted to the next.
+const unsigned long MLFQ_ALLOTMENT = 2 * TIMER_TICKS;
+
+/// Levels a thread may be demoted below its priority.
+const unsigned MLFQ_LEVELS = 8;
+
+/// Ticks between boosts of every thread back to its priority, so that
+/// demoted threads do not starve.
+const unsigned long MLFQ_BOOST_PERIOD = 50 * TIMER_TICKS;
+
+/// Pass a thread holding a single ticket advances for each tick it runs;
+/// one with `n` tickets advances `STRIDE_ONE / n`.
+const unsigned long STRIDE_ONE = 1 << 20;
+
+/// Under completely fair scheduling, the ticks in which every ready thread
+/// should get a turn, and the shortest turn a thread gets, however many
+/// are ready.
+const unsigned long CFS_LATENCY         = 6 * TIMER_TICKS;
+const unsigned long CFS_MIN_GRANULARITY = TIMER_TICKS;
+
+/// Weight of a thread of priority 0 under completely fair scheduling;
+/// each priority below weighs about 1.25 times less.
+const unsigned CFS_WEIGHT_0 = 1024;
+
+/// Most of each CPU that real-time reservations may take together, in
+/// thousandths; the rest is left to the other threads.
+const unsigned RT_MAX_UTILIZATION = 900;
+
+/// Ticks run by a thread, and waited while ready, for the report printed
+/// when the machine halts.
+struct ThreadUsage {
+    char *name;
+    unsigned tickets;
+    unsigned long ticks;
+    unsigned long waited;
+    unsigned long longestWait;
+};
 
+/// Threads ready to run on one CPU: a FIFO queue for each priority, linked
+/// through the threads themselves, and a bitmap of the priorities whose
+/// queues are not empty, so that every operation takes constant time.
+struct ReadyQueue {
+    Thread *first[NUM_PRIORITIES];
+    Thread *last[NUM_PRIORITIES];
+
+    /// Bit `p` is set if the queue of priority `p` is not empty.
+    unsigned nonEmpty;
+};
 
 /// The following class defines the scheduler/dispatcher abstraction --
 /// the data structures and operations needed to keep track of which
@@ -22,16 +89,18 @@
 class Scheduler {
 public:
 
-    /// Initialize list of ready threads.
-    Scheduler();
+    /// Initialize the queues of ready threads, to be served according to
+    /// `policy`.
+    Scheduler(SchedulerPolicy policy);
 
-    /// De-allocate ready list.
+    /// De-allocate the ready queues.
     ~Scheduler();
 
     /// Thread can be dispatched.
     void ReadyToRun(Thread *thread);
 
-    /// Dequeue first thread on the ready list, if any, and return thread.
+    /// Dequeue the first thread of the highest priority, if any, and
+    /// return it.
     Thread *FindNextToRun();
 
     /// Cause `nextThread` to start running.
@@ -43,11 +112,129 @@ public:
     // Agregado ejercicio 4 plancha 2.
     void ChangePriority(Thread *owner);
 
+    /// Called by the timer interrupt handler.  Under MLFQ, raise every
+    /// thread back to its priority if a boost period has passed.
+    void CheckBoost();
+
+    /// Called by the timer interrupt handler.  Give the real-time threads
+    /// that ran out of budget a new period, once the last one is over.
+    void CheckPeriods();
+
+    /// Note that `thread` is about to wait for a device.  Under MLFQ, it is
+    /// raised back to its priority, so that threads doing I/O stay high.
+    void BoostForIo(Thread *thread);
+
+    /// Give `thread` a share of `tickets` under stride scheduling.
+    void SetTickets(Thread *thread, unsigned tickets);
+
+    /// Reserve `budget` ticks of every `period` for `thread`, which then
+    /// runs ahead of the threads without a reservation, whatever the
+    /// policy, earliest deadline first.  A period of 0 gives back the
+    /// reservation.
+    ///
+    /// Returns false, leaving the thread as it was, if the CPU of the
+    /// thread has not that much time left to reserve.
+    bool SetRealTime(Thread *thread, unsigned long period,
+                     unsigned long budget);
+
+    /// Print the ticks each thread ran and waited, under policies other
+    /// than strict priority.
+    void PrintUsage();
+
+    /// Whether the thread running on this CPU has had its turn, so that a
+    /// timer interrupt should switch threads.
+    ///
+    /// Only completely fair scheduling says no, to a thread that has not
+    /// run for its slice yet, or that no other thread waits for; and a
+    /// real-time thread with budget left is only switched for one with an
+    /// earlier deadline.
+    bool SliceExpired();
+
 
 private:
 
-    // Queue of threads that are ready to run, but not running.
-    List<Thread*> *readyList;
+    // Threads that are ready to run, but not running, one queue for each
+    // CPU.
+    ReadyQueue *readyList;
+
+    unsigned numCpus;
+
+    // CPU to assign the next new thread to, round robin.
+    unsigned nextCpu;
+
+    SchedulerPolicy policy;
+
+    /// Boosts so far, and the tick the next one is due at (MLFQ).
+    unsigned boostEpoch;
+    unsigned long nextBoost;
+
+    /// Ready threads of each CPU by pass, and the pass of the thread the
+    /// CPU took last, which threads joining it start from (stride).
+    Heap<Thread *> *passQueue;
+    unsigned long *cpuPass;
+
+    /// Ready threads of each CPU in a balanced tree by virtual runtime,
+    /// their total weight, and the virtual runtime of the thread the CPU
+    /// took last, which threads joining it start from (CFS).
+    Thread **cfsTree;
+    unsigned long *cfsLoad;
+    unsigned long *cpuVruntime;
+
+    /// Real-time threads of each CPU with budget left, by deadline, those
+    /// out of budget until the end of their period, by deadline too, and
+    /// the thousandths of the CPU reserved.
+    Heap<Thread *> *rtQueue;
+    Heap<Thread *> *rtThrottled;
+    unsigned *rtUtilization;
+
+    /// Ticks run by every thread so far, under policies other than strict
+    /// priority, which print no report.
+    ThreadUsage *usage;
+    unsigned numUsage;
+    unsigned maxUsage;
+
+    /// Priority of the queue `thread` belongs in.
+    int QueuePriority(Thread *thread);
+
+    /// Account for the ticks `thread` ran since it was dispatched, or since
+    /// it was last charged.
+    void Charge(Thread *thread);
+
+    /// Give `thread` an entry in `usage`, if it has none.
+    void AddUsage(Thread *thread);
+
+    /// Whether `thread` has a reservation with budget left in its period.
+    static bool HasBudget(const Thread *thread);
+
+    /// Whether the current period of `thread`, a real-time thread, is over.
+    static bool PeriodOver(const Thread *thread);
+
+    /// Begin a new period of `thread`, counting a deadline miss for the
+    /// one before if `missed`.
+    void StartPeriod(Thread *thread, bool missed);
+
+    /// Move the threads of `cpu` out of budget whose period is over back to
+    /// `rtQueue`, with a new one.
+    void Replenish(unsigned cpu);
+
+    /// Dequeue the thread `FindNextToRun` returns.
+    Thread *PickNext();
+
+    /// The tree of ready threads under CFS is an AVL tree, linked through
+    /// the threads.  These return the new root of the subtree changed.
+    static Thread *TreeInsert(Thread *root, Thread *thread);
+    static Thread *TreeRemoveFirst(Thread *root, Thread **first);
+    static Thread *TreeBalance(Thread *root);
+    static Thread *TreeRotate(Thread *root, bool left);
+    static void TreeApply(Thread *root, void (*func)(Thread *));
+    static int TreeHeight(Thread *root);
+    static void TreeResize(Thread *root);
+
+    /// Put `thread` at the end of the queue of priority `prio`.
+    void Enqueue(Thread *thread, int prio);
+
+    /// Take `thread` off the queue it is on.
+    void Dequeue(Thread *thread);
 
 };
 
@@ -14,16 +14,22 @@
 #include "userprog/exception.hh"
 #endif
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef USER_PROGRAM
+#include <thread>
+#endif
 
 
 /// This defines *all* of the global data structures used by Nachos.
 ///
 /// These are all initialized and de-allocated by this file.
 
-Thread *currentThread;        ///< The thread we are running now.
-Thread *threadToBeDestroyed;  ///< The thread that just finished.
+thread_local Thread *currentThread;        ///< The thread we are running
+                                           ///< now.
+thread_local Thread *threadToBeDestroyed;  ///< The thread that just
+                                           ///< finished.
 Scheduler *scheduler;         ///< The ready list.
 Interrupt *interrupt;         ///< Interrupt status.
 Statistics *stats;            ///< Performance metrics.
@@ -31,7 +37,7 @@ Timer *timer;                 ///< The hardware timer device, for invoking
                               ///< context switches.
 
 #ifdef DEMAND_LOADING
-Pair <AddressSpace*,int> coremap[NUM_PHYS_PAGES];
+Pair <AddressSpace*,int> *coremap;  ///< Owner of each frame.
 unsigned victim = 0;
 #endif
 
@@ -50,7 +56,8 @@ FileList *listOpenFiles; ///< lista de archivos abiertos sincronizacion.
 #endif
 
 #ifdef USER_PROGRAM  // Requires either *FILESYS* or *FILESYS_STUB*.
-Machine *machine;  ///< User program memory and registers.
+thread_local Machine *machine;  ///< User program memory and registers.
+Machine *cpuMachines[MAX_CPUS];  ///< The machine of each CPU.
 Bitmap *bmp; /// Verificar paginas.
 Table<Thread*> *spaceIds; // Tabla que guarda los space ids.
 SynchConsole* sconsole;
@@ -80,9 +87,57 @@ extern void Cleanup();
 static void
 TimerInterruptHandler(void *dummy)
 {
-    if (interrupt->GetStatus() != IDLE_MODE)
-        interrupt->YieldOnReturn();
+    scheduler->CheckBoost();
+    scheduler->CheckPeriods();
+    interrupt->YieldAllOnReturn();
+}
+
+#ifdef USER_PROGRAM
+/// Body of the host thread driving CPU `cpu`, other than the first one.
+///
+/// The CPU gets a thread of its own to start from, which it never runs
+/// again: it just idles until threads are assigned to it.
+static void
+StartCpu(unsigned cpu)
+{
+    interrupt->BootCpu(cpu);
+    machine = cpuMachines[cpu];
+    SetExceptionHandlers();
+
+    char *name = new char [16];
+    snprintf(name, 16, "cpu %u", cpu);
+    currentThread = new Thread(name, false, 0);
+    currentThread->SetCpu(cpu);
+    currentThread->SetStatus(RUNNING);
+    currentThread->Sleep();
+}
+
+/// Make a cache as described by `spec`: its size in bytes (with an optional
+/// `K` suffix), its line size and its associativity, separated by colons,
+/// as in `8K:32:2`.  A data cache writes back, unless `:wt` follows.
+static Cache *
+MakeCache(const char *spec, bool data)
+{
+    char *end;
+    unsigned size = strtoul(spec, &end, 0);
+    if (*end == 'K' || *end == 'k') {
+        size <<= 10;
+        end++;
+    }
+    ASSERT(*end == ':');
+    unsigned lineSize = strtoul(end + 1, &end, 0);
+    ASSERT(*end == ':');
+    unsigned ways = strtoul(end + 1, &end, 0);
+    bool writeBack = true;
+    if (data && !strcmp(end, ":wt"))
+        writeBack = false;
+    else if (data && !strcmp(end, ":wb"))
+        writeBack = true;
+    else
+        ASSERT(*end == '\0');
+    return new Cache(size, lineSize, ways, writeBack);
 }
+#endif
 
 /// Initialize Nachos global data structures.
 ///
@@ -104,6 +159,9 @@ Initialize(int argc, char **argv)
     int argCount;
     const char *debugArgs = "";
     bool randomYield = false;
+    const char *replayFile = nullptr;  // Log of interrupts.
+    bool replaying = false;            // Replay it rather than record it.
+    SchedulerPolicy schedPolicy = SCHED_PRIORITY;  // How to pick threads.
 
     // 2007, Jose Miguel Santos Espino
     bool preemptiveScheduling = false;
@@ -111,6 +169,23 @@ Initialize(int argc, char **argv)
 
 #ifdef USER_PROGRAM
     bool debugUserProg = false;  // Single step user program.
+    bool threadedEngine = false;  // Run user programs with the threaded
+                                  // engine.
+    unsigned numCpus = 1;  // Simulated CPUs.
+    bool profile = false;  // Profile user programs.
+    const char *profileFolded = nullptr;  // Where to write call stacks.
+    const char *traceFile = nullptr;  // Where to trace memory references.
+    const char *costFile = nullptr;  // Ticks of user instructions.
+    const char *instrCacheSpec = nullptr;  // Shape of the caches.
+    const char *dataCacheSpec = nullptr;
+    unsigned numPhysPages = DEFAULT_NUM_PHYS_PAGES;  // Size of memory.
+#ifdef USE_TLB
+    unsigned tlbSize = TLB_SIZE;  // TLB entries.
+    unsigned tlbWays = 0;         // TLB entries per set (0 means all).
+    bool tlbWalker = false;       // Refill the TLB in hardware.
+    TlbPolicy tlbPolicy = TLB_FIFO;  // How to choose TLB victims.
+    bool tlbPrefetch = false;     // Load the next page on a TLB miss.
+#endif
     spaceIds = new Table<Thread*>();
 
 #endif
@@ -138,6 +213,26 @@ Initialize(int argc, char **argv)
               // Initialize pseudo-random number generator.
             randomYield = true;
             argCount = 2;
+        } else if (!strcmp(*argv, "-record")
+                     || !strcmp(*argv, "-replay")) {
+            ASSERT(argc > 1);
+            replayFile = *(argv + 1);
+            replaying  = !strcmp(*argv, "-replay");
+            argCount = 2;
+        } else if (!strcmp(*argv, "-sched")) {
+            ASSERT(argc > 1);
+            const char *name = *(argv + 1);
+            if (!strcmp(name, "priority"))
+                schedPolicy = SCHED_PRIORITY;
+            else if (!strcmp(name, "mlfq"))
+                schedPolicy = SCHED_MLFQ;
+            else if (!strcmp(name, "stride"))
+                schedPolicy = SCHED_STRIDE;
+            else if (!strcmp(name, "cfs"))
+                schedPolicy = SCHED_CFS;
+            else
+                ASSERT(false);
+            argCount = 2;
         }
         // 2007, Jose Miguel Santos Espino
         else if (!strcmp(*argv, "-p")) {
@@ -152,6 +247,81 @@ Initialize(int argc, char **argv)
 #ifdef USER_PROGRAM
         if (!strcmp(*argv, "-s"))
             debugUserProg = true;
+        else if (!strcmp(*argv, "-dt"))
+            threadedEngine = true;
+        else if (!strcmp(*argv, "-prof"))
+            profile = true;
+        else if (!strcmp(*argv, "-proffolded")) {
+            ASSERT(argc > 1);
+            profile = true;
+            profileFolded = *(argv + 1);
+            argCount = 2;
+        } else if (!strcmp(*argv, "-mem")) {
+            ASSERT(argc > 1);
+            char *unit;
+            unsigned long size = strtoul(*(argv + 1), &unit, 0);
+            if (*unit == 'K' || *unit == 'k') {
+                size <<= 10;
+                unit++;
+            } else if (*unit == 'M' || *unit == 'm') {
+                size <<= 20;
+                unit++;
+            }
+            ASSERT(*unit == '\0' && size > 0 && size <= MAX_MEMORY_SIZE);
+            numPhysPages = DivRoundUp(size, (unsigned long) PAGE_SIZE);
+            argCount = 2;
+        } else if (!strcmp(*argv, "-costs")) {
+            ASSERT(argc > 1);
+            costFile = *(argv + 1);
+            argCount = 2;
+        } else if (!strcmp(*argv, "-icache")) {
+            ASSERT(argc > 1);
+            instrCacheSpec = *(argv + 1);
+            argCount = 2;
+        } else if (!strcmp(*argv, "-dcache")) {
+            ASSERT(argc > 1);
+            dataCacheSpec = *(argv + 1);
+            argCount = 2;
+        } else if (!strcmp(*argv, "-trace")) {
+            ASSERT(argc > 1);
+            traceFile = *(argv + 1);
+            argCount = 2;
+        }
+#ifndef USE_TLB
+        else if (!strcmp(*argv, "-smp")) {
+            ASSERT(argc > 1);
+            numCpus = atoi(*(argv + 1));
+            argCount = 2;
+        }
+#endif
+#ifdef USE_TLB
+        else if (!strcmp(*argv, "-tlbsize")) {
+            ASSERT(argc > 1);
+            tlbSize = atoi(*(argv + 1));
+            argCount = 2;
+        } else if (!strcmp(*argv, "-tlbways")) {
+            ASSERT(argc > 1);
+            tlbWays = atoi(*(argv + 1));
+            argCount = 2;
+        } else if (!strcmp(*argv, "-tlbwalk"))
+            tlbWalker = true;
+        else if (!strcmp(*argv, "-tlbpolicy")) {
+            ASSERT(argc > 1);
+            const char *name = *(argv + 1);
+            if (!strcmp(name, "fifo"))
+                tlbPolicy = TLB_FIFO;
+            else if (!strcmp(name, "random"))
+                tlbPolicy = TLB_RANDOM;
+            else if (!strcmp(name, "nru"))
+                tlbPolicy = TLB_NRU;
+            else if (!strcmp(name, "lru"))
+                tlbPolicy = TLB_LRU;
+            else
+                ASSERT(false);
+            argCount = 2;
+        } else if (!strcmp(*argv, "-tlbprefetch"))
+            tlbPrefetch = true;
+#endif
 #endif
 #ifdef FILESYS_NEEDED
         if (!strcmp(*argv, "-f"))
@@ -173,8 +343,20 @@ Initialize(int argc, char **argv)
     debug.SetFlags(debugArgs);  // Initialize `DEBUG` messages.
     stats = new Statistics;     // Collect statistics.
     interrupt = new Interrupt;  // Start up interrupt handling.
-    scheduler = new Scheduler;  // Initialize the ready queue.
-    if (randomYield)            // Start the timer (if needed).
+#ifdef USER_PROGRAM
+    // Neither single stepping nor preemption through `ptrace` can follow
+    // more than one host thread.
+    ASSERT(numCpus == 1 || (!debugUserProg && !preemptiveScheduling));
+    interrupt->SetNumCpus(numCpus);
+#endif
+    // Host timed preemption cannot be replayed.
+    ASSERT(replayFile == nullptr || !preemptiveScheduling);
+    if (replayFile != nullptr)  // Before any device schedules interrupts.
+        interrupt->SetReplay(new Replay(replayFile, replaying));
+    scheduler = new Scheduler(schedPolicy);  // Initialize the ready queue.
+    // Start the timer (if needed).  Policies other than strict priority
+    // time slice threads.
+    if (randomYield || schedPolicy != SCHED_PRIORITY)
         timer = new Timer(TimerInterruptHandler, 0, randomYield);
     
     /// Initialize the timer, to call the interrupt handler `timerHandler`
@@ -187,6 +369,7 @@ Initialize(int argc, char **argv)
     // But if it ever tries to give up the CPU, we better have a `Thread`
     // object to save its state.
     currentThread = new Thread("main", false, 0); // agregado ejercicio 3
+    currentThread->SetCpu(0);
     currentThread->SetStatus(RUNNING);
 
     interrupt->Enable();
@@ -200,13 +383,61 @@ Initialize(int argc, char **argv)
 
 #ifdef USER_PROGRAM
     Debugger *d = debugUserProg ? new Debugger : nullptr;
-    machine = new Machine(d);  // This must come first.
+    machine = new Machine(d, threadedEngine, nullptr,  // This must come
+                          numPhysPages);               // first.
+    cpuMachines[0] = machine;
+    for (unsigned i = 1; i < numCpus; i++)
+        cpuMachines[i] = new Machine(nullptr, threadedEngine,
+                                     machine->GetMMU()->mainMemory,
+                                     numPhysPages);
+    if (costFile != nullptr) {
+        bool loaded = machine->GetCostModel()->Load(costFile);
+        ASSERT(loaded);
+        for (unsigned i = 1; i < numCpus; i++)
+            *cpuMachines[i]->GetCostModel() = *machine->GetCostModel();
+    }
+    for (unsigned i = 0; i < numCpus; i++)
+        cpuMachines[i]->GetMMU()->SetCaches(
+          instrCacheSpec != nullptr ? MakeCache(instrCacheSpec, false)
+                                    : nullptr,
+          dataCacheSpec != nullptr ? MakeCache(dataCacheSpec, true)
+                                   : nullptr);
+    if (profile)
+        for (unsigned i = 0; i < numCpus; i++)
+            cpuMachines[i]->SetProfiler(new Profiler(profileFolded));
+    // CPUs other than the first trace to files of their own, suffixed with
+    // their number.
+    for (unsigned i = 0; traceFile != nullptr && i < numCpus; i++) {
+        char *name = new char [strlen(traceFile) + 12];
+        if (i == 0)
+            strcpy(name, traceFile);
+        else
+            sprintf(name, "%s.%u", traceFile, i);
+        MemTrace *trace = new MemTrace(
+          name, &cpuMachines[i]->GetRegisters()[PC_REG]);
+        cpuMachines[i]->GetMMU()->SetTrace(trace);
+        delete [] name;
+    }
+#ifdef USE_TLB
+    if (tlbWays == 0)
+        tlbWays = tlbSize;  // Fully associative.
+    machine->GetMMU()->ConfigureTlb(tlbSize, tlbWays);
+    machine->GetMMU()->SetTlbWalker(tlbWalker);
+    machine->GetMMU()->SetTlbPolicy(tlbPolicy);
+    machine->GetMMU()->SetTlbPrefetch(tlbPrefetch);
+#endif
     SetExceptionHandlers();
-    bmp = new Bitmap(NUM_PHYS_PAGES);
+    bmp = new Bitmap(numPhysPages);
+#ifdef DEMAND_LOADING
+    // Zeros make empty pairs; like main memory, frames never used cost
+    // nothing.
+    coremap = (Pair<AddressSpace*, int> *) SystemDep::MapZeroed(
+                numPhysPages * sizeof *coremap);
+#endif
 
     sconsole = new SynchConsole();
 
-    if (!randomYield)
+    if (timer == nullptr)
         timer = new Timer(TimerInterruptHandler, 0, false);
     SetExceptionHandlers();
 #endif
@@ -223,6 +454,12 @@ Initialize(int argc, char **argv)
 #ifdef NETWORK
     postOffice = new PostOffice(netname, rely, 10);
 #endif
+
+#ifdef USER_PROGRAM
+    // The other CPUs wait for the kernel lock until this one lets it go.
+    for (unsigned i = 1; i < numCpus; i++)
+        std::thread(StartCpu, i).detach();
+#endif
 }
 
 /// Nachos is halting.  De-allocate global data structures.
@@ -231,6 +468,23 @@ Cleanup()
 {
     DEBUG('i', "Cleaning up...\n");
 
+#ifdef USER_PROGRAM
+    // Write out the memory references still buffered.  Those of other CPUs
+    // still running are taken as they are.
+    for (unsigned i = 0; i < interrupt->GetNumCpus(); i++) {
+        if (cpuMachines[i] == nullptr)
+            continue;
+        MemTrace *trace = cpuMachines[i]->GetMMU()->GetTrace();
+        if (trace != nullptr)
+            trace->Flush();
+    }
+#endif
+
+    // Other CPUs may still be running user code on the shared structures,
+    // so leave them for the host to reclaim.
+    if (interrupt->GetNumCpus() > 1)
+        exit(0);
+
     // 2007, Jose Miguel Santos Espino
     delete preemptiveScheduler;
 
@@ -239,6 +493,11 @@ Cleanup()
 #endif
 
 #ifdef USER_PROGRAM
+#ifdef DEMAND_LOADING
+    if (coremap != nullptr)
+        SystemDep::Unmap(coremap, machine->GetMMU()->numPhysPages
+                                    * sizeof *coremap);
+#endif
     delete machine;
     delete bmp;
     delete spaceIds;
@@ -27,8 +27,11 @@ extern void Initialize(int argc, char **argv);
 extern void Cleanup();
 
 
-extern Thread *currentThread;        ///< The thread holding the CPU.
-extern Thread *threadToBeDestroyed;  ///< The thread that just finished.
+// With more than one CPU, each has its own of these.
+extern thread_local Thread *currentThread;        ///< The thread holding
+                                                  ///< the CPU.
+extern thread_local Thread *threadToBeDestroyed;  ///< The thread that just
+                                                  ///< finished.
 extern Scheduler *scheduler;         ///< The ready list.
 extern Interrupt *interrupt;         ///< Interrupt status.
 extern Statistics *stats;            ///< Performance metrics.
@@ -38,7 +41,9 @@ extern Timer *timer;                 ///< The hardware alarm clock.
 #include "machine/machine.hh"
 #include "lib/bitmap.hh"
 #include "userprog/synch_console.hh"
-extern Machine *machine;  // User program memory and registers.
+extern thread_local Machine *machine;  // User program memory and
+                                       // registers of this CPU.
+extern Machine *cpuMachines[MAX_CPUS];  // Those of every CPU.
 extern Bitmap* bmp;
 extern Table<Thread*> *spaceIds;
 extern SynchConsole *sconsole;
@@ -64,7 +69,7 @@ extern PostOffice *postOffice;
 #endif
 
 #ifdef DEMAND_LOADING
-extern Pair <AddressSpace*, int> coremap[NUM_PHYS_PAGES];
+extern Pair <AddressSpace*, int> *coremap;
 extern unsigned victim;
 #endif
 
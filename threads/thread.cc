@@ -57,7 +57,29 @@ Thread::Thread(const char *threadName, bool join, int p)
 
     joinable = join;
     if(joinable) waitChild = new Channel(name);
+    ASSERT(0 <= p && p < (int) NUM_PRIORITIES);
     prio = p;
+    cpu = NO_CPU;
+    readyPrev = nullptr;
+    readyNext = nullptr;
+    readyPrio = -1;
+    dispatchTick = 0;
+    level = 0;
+    levelTicks = 0;
+    boostEpoch = 0;
+    tickets = DEFAULT_TICKETS;
+    pass = 0;
+    usage = -1;
+    vruntime = 0;
+    treeLeft = nullptr;
+    treeRight = nullptr;
+    treeHeight = 0;
+    treeWeight = 0;
+    rtPeriod = 0;
+    rtBudget = 0;
+    rtDeadline = 0;
+    rtUsed = 0;
+    readyTick = 0;
 }
 
 /// De-allocate a thread.
@@ -180,6 +202,8 @@ Thread::Finish(int ret)
     DEBUG('t', "Finishing thread \"%s\"\n", GetName());
     
     if (joinable) waitChild->Send(ret);
+    if (rtPeriod != 0)
+        scheduler->SetRealTime(this, 0, 0);  // Give back its reservation.
 
     threadToBeDestroyed = currentThread;
     Sleep();  // Invokes `SWITCH`.
@@ -350,5 +374,18 @@ Thread::Join(){
 
 void
 Thread::EditPriority(int p){
+    ASSERT(0 <= p && p < (int) NUM_PRIORITIES);
     prio=p;
 }
+
+unsigned
+Thread::GetCpu() const
+{
+    return cpu;
+}
+
+void
+Thread::SetCpu(unsigned c)
+{
+    cpu = c;
+}
@@ -65,6 +65,19 @@ const unsigned MACHINE_STATE_SIZE = 17;
 const unsigned STACK_SIZE = 4 * 1024;
 
 
+/// `Thread::GetCpu` of a thread that has never been ready to run.
+const unsigned NO_CPU = (unsigned) -1;
+
+/// Number of thread priorities.  Priority 0 is the highest, and
+/// `NUM_PRIORITIES - 1` the lowest.
+const unsigned NUM_PRIORITIES = 32;
+
+/// Share of the CPU a thread gets under stride scheduling, relative to the
+/// other threads: the tickets it starts with, and the most it may hold.
+const unsigned DEFAULT_TICKETS = 100;
+const unsigned MAX_TICKETS     = 1 << 16;
+
+
 /// Thread state.
 enum ThreadStatus {
     JUST_CREATED,
@@ -87,6 +100,8 @@ class Channel; // agregado en ejercicio3 practica2
 ///  Some threads also belong to a user address space; threads that only run
 ///  in the kernel have a null address space.
 class Thread {
+    friend class Scheduler;
+
 private:
 
     // NOTE: DO NOT CHANGE the order of these first two members.
@@ -138,6 +153,12 @@ public:
 
     void EditPriority(int p);
 
+    /// CPU the thread runs on, or `NO_CPU` if it has not been assigned one
+    /// yet.
+    unsigned GetCpu() const;
+
+    void SetCpu(unsigned c);
+
 private:
     // Some of the private data for this class is listed above.
 
@@ -160,6 +181,60 @@ private:
 
     int prio;
 
+    /// A thread stays on the same CPU once it is assigned one, because
+    /// while it runs user code, its stack refers to the machine of that
+    /// CPU.
+    unsigned cpu;
+
+    /// Neighbours of the thread in its ready queue, kept by the
+    /// `Scheduler` so that it can queue the thread without allocating.
+    Thread *readyPrev;
+    Thread *readyNext;
+
+    /// Priority of the ready queue the thread is on, or -1 if it is on
+    /// none.
+    int readyPrio;
+
+    /// Tick the thread was dispatched at, or last charged for running.
+    unsigned long dispatchTick;
+
+    /// Multi-level feedback queue state: levels the thread is demoted below
+    /// its priority, ticks run at that level, and the scheduler boost it
+    /// was last demoted after.
+    unsigned level;
+    unsigned long levelTicks;
+    unsigned boostEpoch;
+
+    /// Stride scheduling state: the thread's share, and its pass, which
+    /// grows as it runs, the more the fewer tickets it holds.
+    unsigned tickets;
+    unsigned long pass;
+
+    /// Completely fair scheduling state: the ticks the thread ran, scaled
+    /// down by its weight; and, while it is ready, its place in the tree
+    /// of ready threads and the weight it adds to the CPU's load.
+    unsigned long vruntime;
+    Thread *treeLeft;
+    Thread *treeRight;
+    int treeHeight;
+    unsigned treeWeight;
+
+    /// Real-time reservation, if `rtPeriod` is not 0: the thread may run
+    /// for `rtBudget` ticks in every period, ahead of the threads that
+    /// hold none, earliest deadline first.  `rtDeadline` is the end of the
+    /// current period, and `rtUsed` the ticks run in it.
+    unsigned long rtPeriod;
+    unsigned long rtBudget;
+    unsigned long rtDeadline;
+    unsigned long rtUsed;
+
+    /// Tick the thread was last made ready at.
+    unsigned long readyTick;
+
+    /// Index of the thread's entry in the scheduler's report of ticks run,
+    /// or -1 if it has none yet.
+    int usage;
+
 #ifdef USER_PROGRAM
     /// User-level CPU register state.
     ///
@@ -85,6 +85,14 @@ Yield:
         j       $31
         .end    Yield
 
+        .globl  SetTickets
+        .ent    SetTickets
+SetTickets:
+        addiu   $2, $0, SC_TICKETS
+        syscall
+        j       $31
+        .end    SetTickets
+
         .globl  Create
         .ent    Create
 Create:
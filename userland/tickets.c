@@ -0,0 +1,42 @@
+/// Test program for stride scheduling.
+///
+/// Start three copies of itself, holding 100, 200 and 300 tickets, which
+/// spin for as long each.  The first to finish halts the machine, so run
+/// with `-sched stride`: the ticks run by each, in the report printed at
+/// the halt, should then be about in proportion 1:2:3.
+
+
+#include "syscall.h"
+
+
+#define SPIN 100000
+
+static int
+ParseInt(const char *s)
+{
+    int n = 0;
+    for (; *s >= '0' && *s <= '9'; s++)
+        n = n * 10 + *s - '0';
+    return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        char *args100[] = { "tickets", "100", 0 };
+        char *args200[] = { "tickets", "200", 0 };
+        char *args300[] = { "tickets", "300", 0 };
+        Exec("tickets", args100, 0);
+        Exec("tickets", args200, 0);
+        Exec("tickets", args300, 0);
+        return 0;
+    }
+
+    if (SetTickets(ParseInt(argv[1])) == -1)
+        return 1;
+    for (int i = 0; i < SPIN; i++)
+        ;
+    Halt();
+    return 0;
+}
@@ -14,6 +14,20 @@
 #include <stdlib.h>
 
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
+
+#ifdef USE_TLB
+/// TLB address space identifiers are handed out in generations.  Within a
+/// generation each address space that runs gets a fresh one; when they run
+/// out, the whole TLB is flushed and a new generation starts, so spaces
+/// holding an identifier of an older one get a new identifier the next
+/// time they run.
+static unsigned asidGeneration = 1;
+static unsigned nextTlbAsid    = 0;
+#endif
+
+/// Next number handed out to name an address space in profiles and traces.
+static unsigned nextProfileSpace = 0;
+
 /// First, set up the translation from program memory to physical memory.
 /// For now, this is really simple (1:1), since we are only uniprogramming,
 /// and we have a single unsegmented page table.
@@ -43,14 +57,16 @@ AddressSpace::AddressSpace(OpenFile *executable_file, int id)
 
     unsigned size = exe.GetSize() + USER_STACK_SIZE;
     numPages = DivRoundUp(size, PAGE_SIZE);
-    DEBUG('e', "numPages = %d, NUM_PHYS_PAGES = %d\n", numPages, NUM_PHYS_PAGES);
+    profileSpace = nextProfileSpace++;
+    DEBUG('e', "numPages = %d, numPhysPages = %u\n",
+          numPages, machine->GetMMU()->numPhysPages);
     size = numPages * PAGE_SIZE;
 
 #ifdef DEMAND_LOADING
     exeFile = executable_file;
     asid = id;
 
-    snprintf(swap, 16, "SWAP.%d", asid);
+    snprintf(swap, sizeof swap, "SWAP.%d", asid);
     fileSystem->Create(swap, numPages * PAGE_SIZE);
     //fileSystem->Create(nombre, numPages * PAGE_SIZE);
     // swap = fileSystem->Open(nombre);
@@ -60,6 +76,11 @@ AddressSpace::AddressSpace(OpenFile *executable_file, int id)
     ASSERT(numPages <= bmp->CountClear());
 #endif
 
+#ifdef USE_TLB
+    tlbAsid           = 0;
+    tlbAsidGeneration = 0;  // Not assigned yet.
+#endif
+
     // Check we are not trying to run anything too big -- at least until we
     // have virtual memory.
     DEBUG('a', "Initializing address space, num pages %u, size %u\n",
@@ -79,6 +100,7 @@ AddressSpace::AddressSpace(OpenFile *executable_file, int id)
         pageTable[i].use          = false;
         pageTable[i].dirty        = false;
         pageTable[i].readOnly     = false;
+        pageTable[i].asid         = 0;
         // If the code segment was entirely on a separate page, we could
         // set its pages to be read-only.
     }
@@ -135,13 +157,120 @@ AddressSpace::AddressSpace(OpenFile *executable_file, int id)
 #endif
 }
 
+/// Forget the decoded instructions of `frame` on every CPU.
+///
+/// The other CPUs only do it when they next switch address spaces, as they
+/// may be running user code right now.
+static void
+InvalidateFrameEverywhere(unsigned frame)
+{
+    for (unsigned i = 0; i < interrupt->GetNumCpus(); i++)
+        if (cpuMachines[i] == machine)
+            machine->GetMMU()->InvalidateFrame(frame);
+        else
+            cpuMachines[i]->GetMMU()->InvalidateFrameLater(frame);
+}
+
+/// Rebuild an address space saved by `Checkpoint` into open file `fd`.
+///
+/// Every page goes back to the frame it was in, which must be free.  With
+/// demand loading, `executable_file` is still needed for the pages that
+/// were never loaded.
+AddressSpace::AddressSpace(OpenFile *executable_file, int id, int fd)
+{
+    SystemDep::Read(fd, (char *) &numPages, sizeof numPages);
+    profileSpace = nextProfileSpace++;
+    pageTable = new TranslationEntry[numPages];
+    SystemDep::Read(fd, (char *) pageTable, numPages * sizeof *pageTable);
+    DEBUG('a', "Restoring address space, num pages %u\n", numPages);
+
+#ifdef DEMAND_LOADING
+    ASSERT(executable_file != nullptr);
+    exeFile = executable_file;
+    asid = id;
+
+    snprintf(swap, sizeof swap, "SWAP.%d", asid);
+    fileSystem->Create(swap, numPages * PAGE_SIZE);
+    OpenFile *swapFile = fileSystem->Open(swap);
+#endif
+
+#ifdef USE_TLB
+    tlbAsid           = 0;
+    tlbAsidGeneration = 0;  // Not assigned yet.
+#endif
+
+    char *mainMemory = machine->GetMMU()->mainMemory;
+    for (unsigned i = 0; i < numPages; i++) {
+        unsigned frame = pageTable[i].physicalPage;
+        if (frame != (unsigned) -1) {
+            ASSERT(frame < machine->GetMMU()->numPhysPages
+                   && !bmp->Test(frame));
+            bmp->Mark(frame);
+            InvalidateFrameEverywhere(frame);
+            SystemDep::Read(fd, &mainMemory[frame * PAGE_SIZE], PAGE_SIZE);
+#ifdef DEMAND_LOADING
+            coremap[frame] = Pair<AddressSpace*,int>(this, i);
+        } else if (pageTable[i].dirty) {  // Swapped out.
+            char page[PAGE_SIZE];
+            SystemDep::Read(fd, page, PAGE_SIZE);
+            swapFile->WriteAt(page, PAGE_SIZE, i * PAGE_SIZE);
+#endif
+        }
+    }
+
+#ifdef DEMAND_LOADING
+    delete swapFile;
+#endif
+}
+
+/// Write the page table and the contents of every page to open file `fd`,
+/// for a checkpoint.
+///
+/// With demand loading, the pages that are swapped out are copied from the
+/// swap file.
+void
+AddressSpace::Checkpoint(int fd)
+{
+#ifdef USE_TLB
+    UpdatePageTable();  // Bring in the `use` and `dirty` bits.
+#endif
+
+    SystemDep::WriteFile(fd, (const char *) &numPages, sizeof numPages);
+    SystemDep::WriteFile(fd, (const char *) pageTable,
+                         numPages * sizeof *pageTable);
+
+#ifdef DEMAND_LOADING
+    OpenFile *swapFile = fileSystem->Open(swap);
+#endif
+    const char *mainMemory = machine->GetMMU()->mainMemory;
+    for (unsigned i = 0; i < numPages; i++) {
+        unsigned frame = pageTable[i].physicalPage;
+        if (frame != (unsigned) -1)
+            SystemDep::WriteFile(fd, &mainMemory[frame * PAGE_SIZE],
+                                 PAGE_SIZE);
+#ifdef DEMAND_LOADING
+        else if (pageTable[i].dirty) {
+            char page[PAGE_SIZE];
+            swapFile->ReadAt(page, PAGE_SIZE, i * PAGE_SIZE);
+            SystemDep::WriteFile(fd, page, PAGE_SIZE);
+        }
+#endif
+    }
+#ifdef DEMAND_LOADING
+    delete swapFile;
+#endif
+}
+
 /// Deallocate an address space.
 ///
 /// Nothing for now!
 AddressSpace::~AddressSpace()
 {
     for (unsigned i = 0; i < numPages; i++)
-        if (pageTable[i].physicalPage!= (unsigned) -1) bmp->Clear(pageTable[i].physicalPage);//Chequear esto
+        if (pageTable[i].physicalPage != (unsigned) -1) {
+            InvalidateFrameEverywhere(pageTable[i].physicalPage);
+            bmp->Clear(pageTable[i].physicalPage);//Chequear esto
+        }
     delete [] pageTable;
 
 #ifdef DEMAND_LOADING
@@ -183,13 +312,7 @@ void
 AddressSpace::SaveState()
 {
 #ifdef DEMAND_LOADING
-    for (unsigned i = 0; i < TLB_SIZE; i++) {
-        TranslationEntry e = machine->GetMMU()->tlb[i];
-        if (e.valid) {
-            pageTable[e.virtualPage].use = e.use;
-            pageTable[e.virtualPage].dirty = e.dirty;
-        }
-    }
+    UpdatePageTable();
 #endif
 }
 
@@ -200,83 +323,77 @@ AddressSpace::SaveState()
 void
 AddressSpace::RestoreState()
 {
+    if (machine->GetProfiler() != nullptr)
+        machine->GetProfiler()->SetSpace(profileSpace);
+    if (machine->GetMMU()->GetTrace() != nullptr)
+        machine->GetMMU()->GetTrace()->SetSpace(profileSpace);
+
 #ifndef USE_TLB
     machine->GetMMU()->pageTable     = pageTable;
     machine->GetMMU()->pageTableSize = numPages;
+    machine->GetMMU()->FlushSoftTlb();
 #else
-    for(unsigned i = 0; i < TLB_SIZE; i++)
-        machine->GetMMU()->tlb[i].valid = false;
-#endif
-}
-
-#ifdef DEMAND_LOADING
-uint32_t
-LoadFromCode(Executable exe, uint32_t pageAddr, uint32_t frameAddr) {
-    uint32_t codeSize = exe.GetCodeSize();
-    uint32_t codeStart = exe.GetCodeAddr();
-    uint32_t codeEnd = codeStart + codeSize;
-    ASSERT(codeSize != 0);
-    if (pageAddr >= codeEnd)
-        return 0;
-
-    uint32_t sizeToRead = MIN(PAGE_SIZE, codeEnd - pageAddr);
-    char *mainMemory = machine->GetMMU()->mainMemory;
-
-    exe.ReadCodeBlock(&mainMemory[frameAddr], sizeToRead, pageAddr - codeStart);
+    // Only read by the MMU if its page table walker is on.
+    machine->GetMMU()->pageTable     = pageTable;
+    machine->GetMMU()->pageTableSize = numPages;
 
-    return sizeToRead;
+    // Entries of other spaces stay in the TLB, but do not match.
+    AssignTlbAsid();
+    machine->GetMMU()->SetAsid(tlbAsid);
+#endif
 }
 
-uint32_t
-LoadFromInitData(Executable exe, uint32_t pageAddr, uint32_t frameAddr, uint32_t alreadyRead) {
-    uint32_t initDataSize = exe.GetInitDataSize();
-    uint32_t initDataStart = exe.GetInitDataAddr();
-    uint32_t initDataEnd =  initDataStart + initDataSize; 
-
-    if (alreadyRead == PAGE_SIZE || initDataSize == 0 || pageAddr + alreadyRead >= initDataEnd)// primera condicion para ver si leiste toda la pagina y no queda nada por leer
-        return alreadyRead;
-
-    uint32_t sizeToRead; 
-    char *mainMemory = machine->GetMMU()->mainMemory;
+#ifdef USE_TLB
+/// Make sure this address space has a TLB identifier of the current
+/// generation, starting a new generation if needed.
+void
+AddressSpace::AssignTlbAsid()
+{
+    if (tlbAsidGeneration == asidGeneration)
+        return;
 
-    if (alreadyRead == 0) {
-        sizeToRead = MIN(PAGE_SIZE, initDataEnd - pageAddr);
-        exe.ReadDataBlock(&mainMemory[frameAddr], sizeToRead, pageAddr - initDataStart);
+    if (nextTlbAsid == NUM_TLB_ASIDS) {
+        machine->GetMMU()->FlushTlb();
+        asidGeneration++;
+        nextTlbAsid = 0;
     }
-    else {
-        sizeToRead = MIN(PAGE_SIZE - alreadyRead, initDataSize);
-        exe.ReadDataBlock(&mainMemory[frameAddr + alreadyRead], sizeToRead, 0);
-    }
-
-    return alreadyRead + sizeToRead;
+    tlbAsid           = nextTlbAsid++;
+    tlbAsidGeneration = asidGeneration;
 }
+#endif
 
-uint32_t
-LoadRest(Executable exe, uint32_t frameAddr, uint32_t alreadyRead) {
-
-    if (alreadyRead == PAGE_SIZE)
-        return alreadyRead;
-
-    char *mainMemory = machine->GetMMU()->mainMemory;
-    uint32_t sizeToWrite = PAGE_SIZE - alreadyRead;
-    memset(&mainMemory[frameAddr + alreadyRead], 0, sizeToWrite);
-
-    return alreadyRead + sizeToWrite;
+#ifdef DEMAND_LOADING
+/// Copy into `frame` the part of a segment of `exe` that falls in the page
+/// at `pageAddr`, reading it with `read`.  With pages of several sectors, a
+/// page may hold the end of one segment and the start of the next, each at
+/// its own offset.
+static void
+LoadSegmentPart(Executable *exe,
+                int (Executable::*read)(char *, uint32_t, uint32_t),
+                uint32_t segmentAddr, uint32_t segmentSize,
+                uint32_t pageAddr, char *frame)
+{
+    uint32_t start = segmentAddr > pageAddr ? segmentAddr : pageAddr;
+    uint32_t end   = MIN(segmentAddr + segmentSize, pageAddr + PAGE_SIZE);
+    if (segmentSize == 0 || start >= end)
+        return;
+    (exe->*read)(&frame[start - pageAddr], end - start, start - segmentAddr);
 }
 
 void
 UpdateTLB(unsigned fn)
 {
-    for (unsigned i = 0; i < TLB_SIZE; i++)
+    for (unsigned i = 0; i < machine->GetMMU()->tlbSize; i++)
         if (machine->GetMMU()->tlb[i].valid && fn == machine->GetMMU()->tlb[i].physicalPage)
             machine->GetMMU()->tlb[i].valid = false;
+    machine->GetMMU()->FlushSoftTlb();
 }
 
 void
 AddressSpace::UpdatePageTable() {
-    for (unsigned i = 0; i < TLB_SIZE; i++) {
+    for (unsigned i = 0; i < machine->GetMMU()->tlbSize; i++) {
         TranslationEntry e = machine->GetMMU()->tlb[i];
-        if (e.valid) {
+        if (e.valid && e.asid == tlbAsid) {
             pageTable[e.virtualPage].use = e.use;
             pageTable[e.virtualPage].dirty = e.dirty;
         }
@@ -286,13 +403,13 @@ AddressSpace::UpdatePageTable() {
 void
 printCoremap()
 {
-    for (unsigned i = 0; i < NUM_PHYS_PAGES; i++)
+    for (unsigned i = 0; i < machine->GetMMU()->numPhysPages; i++)
         printf("coremap[%d] = (%d, %d)\n", i, coremap[i].fst->asid, coremap[i].snd);
 }
 
 int
 AddressSpace::Fifo() {
-    return victim++ % NUM_PHYS_PAGES;
+    return victim++ % machine->GetMMU()->numPhysPages;
 }
 
 #ifdef LRU
@@ -302,10 +419,10 @@ int AddressSpace::Lru() {
     do {
         if (!coremap[i].fst->pageTable[coremap[i].snd].use)
             break;
-        i = (i + 1) % NUM_PHYS_PAGES;
+        i = (i + 1) % machine->GetMMU()->numPhysPages;
     } while (i != victim);
-    if (i == victim) i = rand() % NUM_PHYS_PAGES;
-    victim = (i + 1) % NUM_PHYS_PAGES;
+    if (i == victim) i = rand() % machine->GetMMU()->numPhysPages;
+    victim = (i + 1) % machine->GetMMU()->numPhysPages;
     return i;
 }
 
@@ -323,7 +440,7 @@ AddressSpace::Lru() {
             printf("Rompe aca, i: %d, par.snd: %d\n", i, par.snd);
             break;
         }
-        i = (i + 1) % NUM_PHYS_PAGES;
+        i = (i + 1) % machine->GetMMU()->numPhysPages;
     } while (i != victim);
     if (i == victim) {
         do {
@@ -331,10 +448,10 @@ AddressSpace::Lru() {
             par.fst->pageTable[par.snd].use = false;  // <--- Cambiado
             if (!par.fst->pageTable[par.snd].dirty)
                 break;
-            i = (i + 1) % NUM_PHYS_PAGES;
+            i = (i + 1) % machine->GetMMU()->numPhysPages;
         } while (i != victim);
     }
-    victim = (i + 1) % NUM_PHYS_PAGES;
+    victim = (i + 1) % machine->GetMMU()->numPhysPages;
     printf("i:%d, victim:%d \n", i, victim);
     return i;
 }
@@ -353,16 +470,18 @@ void
 AddressSpace::LoadFromExecutable(int vpn, int frameAddr) {
     Executable exe (exeFile);
     ASSERT(exe.CheckMagic());
-    uint32_t alreadyRead = 0;
     uint32_t pageAddr = vpn * PAGE_SIZE;
+    char *frame = &machine->GetMMU()->mainMemory[frameAddr];
 
     DEBUG('v', "codeAddr: %u, codeSize: %u.\ninitDataAddr: %u, initDataSize: %u.\nvpn: %d\n", exe.GetCodeAddr(),
             exe.GetCodeSize(), exe.GetInitDataAddr(), exe.GetInitDataSize(), vpn);
 
-    alreadyRead = LoadFromCode(exe, pageAddr, frameAddr);
-    alreadyRead = LoadFromInitData(exe, pageAddr, frameAddr, alreadyRead);
-    alreadyRead = LoadRest(exe, frameAddr, alreadyRead);
-    ASSERT(alreadyRead == PAGE_SIZE);
+    // Whatever no segment covers is uninitialized data or stack.
+    memset(frame, 0, PAGE_SIZE);
+    LoadSegmentPart(&exe, &Executable::ReadCodeBlock, exe.GetCodeAddr(),
+                    exe.GetCodeSize(), pageAddr, frame);
+    LoadSegmentPart(&exe, &Executable::ReadDataBlock, exe.GetInitDataAddr(),
+                    exe.GetInitDataSize(), pageAddr, frame);
 }
 
 void
@@ -391,12 +510,16 @@ AddressSpace::LoadPage(unsigned vpn) {
         UpdateTLB(fn);
     }
 
+    // The frame is about to be overwritten behind the back of the MMU.
+    machine->GetMMU()->InvalidateFrame(fn);
+
     if (pageTable[vpn].dirty)
         LoadFromSwap(vpn, fn * PAGE_SIZE);
     else
         LoadFromExecutable(vpn, fn * PAGE_SIZE);
 
     pageTable[vpn].physicalPage = fn;
+    machine->Stall(machine->GetCostModel()->pageFault);
     // Print();
     coremap[fn] = Pair<AddressSpace*,int>(this, vpn);
 }
@@ -38,12 +38,19 @@ public:
     ///   program; it contains the object code to load into memory.
     AddressSpace(OpenFile *executable_file, int id);
 
+    /// Create an address space saved in a checkpoint, from the open host
+    /// file `fd`.
+    AddressSpace(OpenFile *executable_file, int id, int fd);
+
     /// De-allocate an address space.
     ~AddressSpace();
 
     /// Initialize user-level CPU registers, before jumping to user code.
     void InitRegisters();
 
+    /// Write the whole address space to the open host file `fd`.
+    void Checkpoint(int fd);
+
     /// Save/restore address space-specific info on a context switch.
 
     void SaveState();
@@ -70,13 +77,26 @@ public:
     int asid;
 private:
 
+    /// Number of this space in profiles and memory traces of user programs;
+    /// unlike `asid`, never reused.
+    unsigned profileSpace;
+
     /// Assume linear page table translation for now!
 
     /// Number of pages in the virtual address space.
 
     #ifdef DEMAND_LOADING
     OpenFile* exeFile;
-    char swap[10];
+    char swap[17];  ///< Room for `SWAP.` and any `int`.
+    #endif
+
+    #ifdef USE_TLB
+    /// Identifier tagging this space's entries in the TLB, and the
+    /// generation it was handed out in (see `AssignTlbAsid`).
+    unsigned tlbAsid;
+    unsigned tlbAsidGeneration;
+
+    void AssignTlbAsid();
     #endif
 
 public:
@@ -4,6 +4,7 @@
 
 
 #include "transfer.hh"
+#include "machine/endianness.hh"
 #include "machine/machine.hh"
 #include "threads/system.hh"
 
@@ -26,14 +27,8 @@ bool CountArgsToSave(int address, unsigned *count)
     int val;
     unsigned c = 0;
     do {
-
-        //machine->ReadMem(address + 4 * c, 4, &val);
-        int j=0;
-        for(;j<5;j++){
-            if(machine->ReadMem(address + 4 * c, 4, &val)) break;
-        }
-        ASSERT(j<5);//terminaron las iteraciones y no ejecuto bien la funcion
-
+        ReadBufferFromUser(address + 4 * c, (char *) &val, 4);
+        val = WordToHost(val);
         c++;
     } while (c < MAX_ARG_COUNT && val != 0);
     if (c == MAX_ARG_COUNT && val != 0)
@@ -61,19 +56,15 @@ SaveArgs(int address)
     // always be at least 1.
     char **args = new char * [count + 1];
 
+    // Read all the pointers at once.
+    int strAddrs[MAX_ARG_COUNT];
+    if (count > 0)
+        ReadBufferFromUser(address, (char *) strAddrs, count * 4);
+
     for (unsigned i = 0; i < count; i++) {
         args[i] = new char [MAX_ARG_LENGTH];
-        int strAddr;
         // For each pointer, read the corresponding string.
-
-        //machine->ReadMem(address + i * 4, 4, &strAddr);
-        int j=0;
-        for(;j<5;j++){
-            if(machine->ReadMem(address + i * 4, 4, &strAddr)) break;
-        }
-        ASSERT(j<5);//terminaron las iteraciones y no ejecuto bien la funcion
-
-        ReadStringFromUser(strAddr, args[i], MAX_ARG_LENGTH);
+        ReadStringFromUser(WordToHost(strAddrs[i]), args[i], MAX_ARG_LENGTH);
     }
     args[count] = nullptr;  // Write the trailing null.
 
@@ -106,24 +97,13 @@ WriteArgs(char **args)
 
     sp -= sp % 4;     // Align the stack to a multiple of four.
     sp -= c * 4 + 4;  // Make room for `argv`, including the trailing null.
-    // Write each argument's address.
-    for (unsigned i = 0; i < c; i++){
-        //machine->WriteMem(sp + 4 * i, 4, argsAddress[i]);
-
-        int j=0;
-        for(;j<5;j++){
-            if(machine->WriteMem(sp + 4 * i, 4, argsAddress[i])) break;
-        }
-        ASSERT(j<5);//terminaron las iteraciones y no ejecuto bien la funcion
-    }
+    // Write each argument's address, and the trailing null, in one go.
+    int argv[MAX_ARG_COUNT + 1];
+    for (unsigned i = 0; i < c; i++)
+        argv[i] = WordToMachine(argsAddress[i]);
+    argv[c] = 0;  // The last is null.
+    WriteBufferToUser((const char *) argv, sp, (c + 1) * 4);
 
-    //machine->WriteMem(sp + 4 * c, 4, 0);  // The last is null.
-    int j=0;
-    for(;j<5;j++){
-        if(machine->WriteMem(sp + 4 * c, 4, 0)) break;
-    }
-    ASSERT(j<5);//terminaron las iteraciones y no ejecuto bien la funcion
-    
     sp -= 16;  // Make room for the register saves.
 
     machine->WriteRegister(STACK_REG, sp);
@@ -0,0 +1,177 @@
+/// Routines to save and restore checkpoints.
+///
+/// A checkpoint starts with a header, followed by:
+///
+/// * the name of the program;
+/// * the statistics, as they are in memory;
+/// * the type and time of each pending interrupt;
+/// * the registers;
+/// * the address space (see `AddressSpace::Checkpoint`);
+/// * with demand loading, the next victim frame.
+///
+/// Copyright (c) 2016-2020 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+
+#include "checkpoint.hh"
+#include "address_space.hh"
+#include "threads/system.hh"
+
+#include <stdio.h>
+#include <string.h>
+
+
+static const char CHECKPOINT_MAGIC[8] = {
+    'N', 'A', 'C', 'H', 'C', 'K', 'P', 'T'
+};
+
+/// Most pending interrupts a checkpoint can hold.
+static const unsigned MAX_PENDING = 64;
+
+/// Longest program name a checkpoint can hold; names are host paths when
+/// the file system is a stub.
+static const unsigned MAX_NAME_LENGTH = 1024;
+
+/// Layout of the data that depends on how Nachos was built, so that a
+/// checkpoint is not restored by a build that would misread it.
+static const unsigned CHECKPOINT_LAYOUT =
+    sizeof (Statistics) << 16 | sizeof (TranslationEntry) << 8
+#ifdef DEMAND_LOADING
+    | 1
+#endif
+#ifdef USE_TLB
+    | 2
+#endif
+    ;
+
+struct CheckpointHeader {
+    char magic[8];
+    unsigned layout;
+    unsigned pageSize;
+    unsigned numPhysPages;  ///< Frames of memory, set by `-mem`.
+    unsigned nameLength;  ///< Not counting the null character.
+    unsigned numPending;
+};
+
+void
+WriteCheckpoint(const char *fileName, const char *programName)
+{
+    ASSERT(fileName != nullptr);
+    ASSERT(programName != nullptr);
+    ASSERT(currentThread->space != nullptr);
+    ASSERT(strlen(programName) <= MAX_NAME_LENGTH);
+
+    IntType types[MAX_PENDING];
+    unsigned long times[MAX_PENDING];
+
+    CheckpointHeader header;
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof header.magic);
+    header.layout       = CHECKPOINT_LAYOUT;
+    header.pageSize     = PAGE_SIZE;
+    header.numPhysPages = machine->GetMMU()->numPhysPages;
+    header.nameLength   = strlen(programName);
+    header.numPending   = interrupt->SavePending(types, times, MAX_PENDING);
+    ASSERT(header.numPending <= MAX_PENDING);
+
+    int fd = SystemDep::OpenForWrite(fileName);
+    SystemDep::WriteFile(fd, (const char *) &header, sizeof header);
+    SystemDep::WriteFile(fd, programName, header.nameLength + 1);
+    SystemDep::WriteFile(fd, (const char *) stats, sizeof *stats);
+    if (header.numPending > 0) {
+        SystemDep::WriteFile(fd, (const char *) types,
+                             header.numPending * sizeof *types);
+        SystemDep::WriteFile(fd, (const char *) times,
+                             header.numPending * sizeof *times);
+    }
+    SystemDep::WriteFile(fd, (const char *) machine->GetRegisters(),
+                         NUM_TOTAL_REGS * sizeof (int));
+    currentThread->space->Checkpoint(fd);
+#ifdef DEMAND_LOADING
+    SystemDep::WriteFile(fd, (const char *) &victim, sizeof victim);
+#endif
+    SystemDep::Close(fd);
+
+    DEBUG('a', "Checkpoint of \"%s\" written to %s at time %lu\n",
+          programName, fileName, stats->totalTicks);
+}
+
+bool
+ReadCheckpoint(const char *fileName)
+{
+    ASSERT(fileName != nullptr);
+    ASSERT(currentThread->space == nullptr);
+
+    int fd = SystemDep::OpenForReadWrite(fileName, false);
+    if (fd < 0) {
+        printf("Unable to open checkpoint %s\n", fileName);
+        return false;
+    }
+
+    CheckpointHeader header;
+    if (SystemDep::ReadPartial(fd, (char *) &header, sizeof header)
+            != (int) sizeof header
+          || memcmp(header.magic, CHECKPOINT_MAGIC, sizeof header.magic) != 0
+          || header.layout != CHECKPOINT_LAYOUT
+          || header.pageSize != PAGE_SIZE
+          || header.nameLength > MAX_NAME_LENGTH
+          || header.numPending > MAX_PENDING) {
+        printf("%s is not a checkpoint of this build of Nachos\n", fileName);
+        SystemDep::Close(fd);
+        return false;
+    }
+    if (header.numPhysPages != machine->GetMMU()->numPhysPages) {
+        printf("%s was taken with %u pages of memory, not %u\n", fileName,
+               header.numPhysPages, machine->GetMMU()->numPhysPages);
+        SystemDep::Close(fd);
+        return false;
+    }
+
+    // Only needed to load pages on demand, but it must still be there.
+    char *programName = new char [header.nameLength + 1];
+    SystemDep::Read(fd, programName, header.nameLength + 1);
+    OpenFile *executable = fileSystem->Open(programName);
+    if (executable == nullptr) {
+        printf("Unable to open file %s\n", programName);
+        delete [] programName;
+        SystemDep::Close(fd);
+        return false;
+    }
+
+    Statistics saved;
+    SystemDep::Read(fd, (char *) &saved, sizeof saved);
+
+    IntType types[MAX_PENDING];
+    unsigned long times[MAX_PENDING];
+    if (header.numPending > 0) {
+        SystemDep::Read(fd, (char *) types,
+                        header.numPending * sizeof *types);
+        SystemDep::Read(fd, (char *) times,
+                        header.numPending * sizeof *times);
+    }
+    interrupt->RestorePending(types, times, header.numPending,
+                              saved.totalTicks);
+    *stats = saved;
+
+    int registers[NUM_TOTAL_REGS];
+    SystemDep::Read(fd, (char *) registers, sizeof registers);
+
+    AddressSpace *space = new AddressSpace(executable,
+                                           currentThread->myId, fd);
+    currentThread->space = space;
+#ifndef DEMAND_LOADING
+    delete executable;
+#else
+    SystemDep::Read(fd, (char *) &victim, sizeof victim);
+#endif
+    SystemDep::Close(fd);
+
+    space->RestoreState();
+    for (unsigned i = 0; i < NUM_TOTAL_REGS; i++)
+        machine->WriteRegister(i, registers[i]);
+
+    DEBUG('a', "Checkpoint of \"%s\" restored from %s at time %lu\n",
+          programName, fileName, stats->totalTicks);
+    delete [] programName;
+    return true;
+}
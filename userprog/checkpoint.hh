@@ -0,0 +1,25 @@
+/// Checkpoints of a user program about to start, to skip booting, loading
+/// and any other warm-up when running it again.
+///
+/// Copyright (c) 2016-2020 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+#ifndef NACHOS_USERPROG_CHECKPOINT__HH
+#define NACHOS_USERPROG_CHECKPOINT__HH
+
+
+/// Write the state of the machine to host file `fileName`: the statistics,
+/// the pending interrupts, the registers and the address space of the
+/// current thread, which runs the program in Nachos file `programName`.
+void WriteCheckpoint(const char *fileName, const char *programName);
+
+/// Restore a checkpoint written by `WriteCheckpoint` into the current
+/// thread, which is left ready to run the program.
+///
+/// Returns false if the file cannot be read, or was written by a different
+/// build of Nachos.
+bool ReadCheckpoint(const char *fileName);
+
+
+#endif
@@ -131,8 +131,9 @@ CommandDump(char **args, void *extra)
         return DCM::RUN_RESULT_STAY;
     }
 
-    int rv = fwrite(machine->GetMMU()->mainMemory, 1, MEMORY_SIZE, f);
-    if (rv != MEMORY_SIZE) {
+    unsigned memorySize = machine->GetMMU()->numPhysPages * PAGE_SIZE;
+    unsigned rv = fwrite(machine->GetMMU()->mainMemory, 1, memorySize, f);
+    if (rv != memorySize) {
         fprintf(stderr, "ERROR: write to file `%s` did not succeed.\n",
                 path);
         return DCM::RUN_RESULT_STAY;
@@ -208,7 +209,7 @@ CommandPrint(char **args, void *extra)
                 printf("Exception on memory read: %u\n", e);
 
         } else if (strcmp(end, "@p") == 0) {
-            if (address >= MEMORY_SIZE) {
+            if (address >= machine->GetMMU()->numPhysPages * PAGE_SIZE) {
                 fprintf(stderr, "ERROR: address %u is too big.\n", address);
                 return DCM::RUN_RESULT_STAY;
             }
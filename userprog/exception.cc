@@ -333,6 +333,17 @@ SyscallHandler(ExceptionType _et)
             machine->WriteRegister(2, t->Join());
             break;
         }
+        case SC_TICKETS: {
+            int tickets = machine->ReadRegister(4);
+            if (tickets < 1 || tickets > (int) MAX_TICKETS) {
+                DEBUG('e', "Error: %d tickets out of range.\n", tickets);
+                machine->WriteRegister(2, -1);
+                break;
+            }
+            scheduler->SetTickets(currentThread, tickets);
+            machine->WriteRegister(2, 0);
+            break;
+        }
         default:
             fprintf(stderr, "Unexpected system call: id %d.\n", scid);
             ASSERT(false);
@@ -346,7 +357,7 @@ printTLB() {
     static int iter = 0;
     printf("(%d) \n", iter);
     TranslationEntry *tlb = machine->GetMMU()->tlb;
-    for (unsigned i = 0; i < TLB_SIZE; i++) {
+    for (unsigned i = 0; i < machine->GetMMU()->tlbSize; i++) {
         printf("tlb[%d] = { virtualPage = %d, physicalPage = %d, valid = %d, use = %d, dirty = %d, readOnly = %d }\n",
                 i,
                 tlb[i].virtualPage,
@@ -364,7 +375,6 @@ printTLB() {
 static void
 PageFaultHandler(ExceptionType et) {
 #ifdef USE_TLB
-    static int i = 0;
     unsigned vaddr = machine->ReadRegister(BAD_VADDR_REG);
     unsigned vpn = vaddr / PAGE_SIZE;
     ASSERT(vpn < currentThread->space->numPages);
@@ -375,8 +385,16 @@ PageFaultHandler(ExceptionType et) {
         currentThread->space->LoadPage(vpn);
     #endif
 
-    machine->GetMMU()->tlb[i] = currentThread->space->pageTable[vpn];
-    i = (i + 1) % TLB_SIZE;
+    machine->GetMMU()->RefillTlb(currentThread->space->pageTable[vpn]);
+
+    // Sequential accesses are likely to cross into the next page soon.
+    // Only bring it in if it is already in memory.
+    unsigned next = vpn + 1;
+    if (machine->GetMMU()->GetTlbPrefetch()
+          && next < currentThread->space->numPages
+          && currentThread->space->pageTable[next].physicalPage
+               < machine->GetMMU()->numPhysPages)
+        machine->GetMMU()->PrefetchTlb(currentThread->space->pageTable[next]);
 #endif
 }
 
@@ -1,7 +1,8 @@
 /// Test routines for demonstrating that Nachos can load a user program and
 /// execute it.
 ///
-/// Also, routines for testing the Console hardware device.
+/// Also, routines for testing the Console hardware device, and the
+/// arithmetic of the simulated CPU.
 ///
 /// Copyright (c) 1992-1993 The Regents of the University of California.
 ///               2016-2020 Docentes de la Universidad Nacional de Rosario.
@@ -10,18 +11,22 @@
 
 
 #include "address_space.hh"
+#include "checkpoint.hh"
 #include "machine/console.hh"
 #include "threads/synch.hh"
 #include "threads/system.hh"
 
+#include <limits.h>
 #include <stdio.h>
 
 
 /// Run a user program.
 ///
-/// Open the executable, load it into memory, and jump to it.
+/// Open the executable, load it into memory, and jump to it.  If
+/// `checkpoint` is not null, save a checkpoint to that host file right
+/// before jumping.
 void
-StartProcess(const char *filename)
+StartProcess(const char *filename, const char *checkpoint)
 {
     ASSERT(filename != nullptr);
 
@@ -41,11 +46,27 @@ StartProcess(const char *filename)
     space->InitRegisters();  // Set the initial register values.
     space->RestoreState();   // Load page table register.
 
+    if (checkpoint != nullptr)
+        WriteCheckpoint(checkpoint, filename);
+
     machine->Run();  // Jump to the user progam.
     ASSERT(false);   // `machine->Run` never returns; the address space
                      // exits by doing the system call `Exit`.
 }
 
+/// Run a user program from a checkpoint saved by `StartProcess`.
+void
+RestoreProcess(const char *checkpoint)
+{
+    ASSERT(checkpoint != nullptr);
+
+    if (!ReadCheckpoint(checkpoint))
+        return;
+
+    machine->Run();  // Jump back to where the program was.
+    ASSERT(false);
+}
+
 /// Data structures needed for the console test.
 ///
 /// Threads making I/O requests wait on a `Semaphore` to delay until the I/O
@@ -71,16 +92,23 @@ WriteDone(void *arg)
     writeDone->V();
 }
 
+/// Real-time reservation of the console echo: a character may come in every
+/// `CONSOLE_TIME` ticks.
+const unsigned long ECHO_PERIOD = CONSOLE_TIME;
+const unsigned long ECHO_BUDGET = CONSOLE_TIME / 2;
+
 /// Test the console by echoing characters typed at the input onto the
 /// output.
 ///
-/// Stop when the user types a `q`.
+/// The echo runs ahead of the other threads, unless the reservation is
+/// refused.  Stop when the user types a `q`.
 void
 ConsoleTest(const char *in, const char *out)
 {
     console   = new Console(in, out, ReadAvail, WriteDone, 0);
     readAvail = new Semaphore("read avail", 0);
     writeDone = new Semaphore("write done", 0);
+    scheduler->SetRealTime(currentThread, ECHO_PERIOD, ECHO_BUDGET);
 
     for (;;) {
         readAvail->P();        // Wait for character to arrive.
@@ -88,6 +116,167 @@ ConsoleTest(const char *in, const char *out)
         console->PutChar(ch);  // Echo it!
         writeDone->P();        // Wait for write to finish.
         if (ch == 'q')
-            return;  // If `q`, then quit.
+            break;  // If `q`, then quit.
+    }
+    scheduler->SetRealTime(currentThread, 0, 0);
+}
+
+/// Multiplication as Nachos always simulated it, one bit at a time, to
+/// check `Mult` against.
+///
+/// The words at `*hiPtr` and `*loPtr` are overwritten with the double-length
+/// result of the multiplication.
+static void
+ReferenceMult(int a, int b, bool signedArith, int *hiPtr, int *loPtr)
+{
+    ASSERT(hiPtr != nullptr);
+    ASSERT(loPtr != nullptr);
+
+    if (a == 0 || b == 0) {
+        *hiPtr = *loPtr = 0;
+        return;
+    }
+
+    // Compute the sign of the result, then make everything positive so
+    // unsigned computation can be done in the main loop.
+    bool negative = false;
+    if (signedArith) {
+        if (a < 0) {
+            negative = !negative;
+            a = -a;
+        }
+        if (b < 0) {
+            negative = !negative;
+            b = -b;
+        }
+    }
+
+    // Compute the result in unsigned arithmetic (check `a`'s bits one at a
+    // time, and add in a shifted value of `b`).
+    unsigned bLo = b;
+    unsigned bHi = 0;
+    unsigned lo = 0;
+    unsigned hi = 0;
+    for (unsigned i = 0; i < 32; i++) {
+        if (a & 1) {
+            lo += bLo;
+            if (lo < bLo)  // Carry out of the low bits?
+                hi += 1;
+            hi += bHi;
+            if ((a & 0xFFFFFFFE) == 0)
+                break;
+        }
+        bHi <<= 1;
+        if (bLo & 0x80000000)
+            bHi |= 1;
+
+        bLo <<= 1;
+        a >>= 1;
+    }
+
+    // If the result is supposed to be negative, compute the two's complement
+    // of the double-word result.
+    if (negative) {
+        hi = ~hi;
+        lo = ~lo;
+        lo++;
+        if (lo == 0)
+            hi++;
+    }
+
+    *hiPtr = (int) hi;
+    *loPtr = (int) lo;
+}
+
+/// A random word, with its bits spread over the whole range.
+static int
+RandomWord()
+{
+    return (int) ((unsigned) SystemDep::Random() << 16
+                  ^ (unsigned) SystemDep::Random());
+}
+
+/// Check the arithmetic of one pair of operands against the reference
+/// routines; return the number of mismatches found.
+static unsigned
+CheckArithmetic(int a, int b)
+{
+    unsigned bad = 0;
+
+    for (unsigned s = 0; s < 2; s++) {
+        int hi, lo, refHi, refLo;
+        Mult(a, b, s == 0, &hi, &lo);
+        ReferenceMult(a, b, s == 0, &refHi, &refLo);
+        if (hi != refHi || lo != refLo) {
+            printf("%s 0x%08X 0x%08X: got 0x%08X:%08X, expected"
+                   " 0x%08X:%08X\n", s == 0 ? "mult" : "multu",
+                   a, b, hi, lo, refHi, refLo);
+            bad++;
+        }
+    }
+
+    int hi, lo;
+    int refHi = 0, refLo = 0;
+    Div(a, b, true, &hi, &lo);
+    if (b == 0)
+        ;
+    else if (a == INT_MIN && b == -1)
+        refLo = INT_MIN;
+    else {
+        refLo = a / b;
+        refHi = a % b;
     }
+    if (hi != refHi || lo != refLo) {
+        printf("div 0x%08X 0x%08X: got 0x%08X:%08X\n", a, b, hi, lo);
+        bad++;
+    }
+    Div(a, b, false, &hi, &lo);
+    refLo = b == 0 ? 0 : (int) ((unsigned) a / (unsigned) b);
+    refHi = b == 0 ? 0 : (int) ((unsigned) a % (unsigned) b);
+    if (hi != refHi || lo != refLo) {
+        printf("divu 0x%08X 0x%08X: got 0x%08X:%08X\n", a, b, hi, lo);
+        bad++;
+    }
+
+    // Overflow as the engines used to tell it, from the sign bits.
+    int sum, diff;
+    unsigned refSum  = (unsigned) a + (unsigned) b;
+    unsigned refDiff = (unsigned) a - (unsigned) b;
+    bool sumOverflows  = !((a ^ b) & SIGN_BIT) && (a ^ refSum) & SIGN_BIT;
+    bool diffOverflows = (a ^ b) & SIGN_BIT && (a ^ refDiff) & SIGN_BIT;
+    if (AddOverflows(a, b, &sum) != sumOverflows
+          || (!sumOverflows && (unsigned) sum != refSum)) {
+        printf("add 0x%08X 0x%08X: wrong sum or overflow\n", a, b);
+        bad++;
+    }
+    if (SubOverflows(a, b, &diff) != diffOverflows
+          || (!diffOverflows && (unsigned) diff != refDiff)) {
+        printf("sub 0x%08X 0x%08X: wrong difference or overflow\n", a, b);
+        bad++;
+    }
+    return bad;
+}
+
+/// Check the multiplication, division and overflow checked arithmetic of
+/// the simulated CPU against the reference routines, over the edge cases
+/// and `n` random pairs of operands.
+void
+ArithmeticTest(unsigned n)
+{
+    static const int EDGES[] = {
+        0, 1, -1, 2, -2, 0x7FFF, 0x8000, 0xFFFF, 0x10000,
+        INT_MAX, INT_MIN, INT_MAX - 1, INT_MIN + 1
+    };
+    const unsigned numEdges = sizeof EDGES / sizeof *EDGES;
+
+    unsigned bad = 0;
+    for (unsigned i = 0; i < numEdges; i++)
+        for (unsigned j = 0; j < numEdges; j++)
+            bad += CheckArithmetic(EDGES[i], EDGES[j]);
+    for (unsigned i = 0; i < n; i++)
+        bad += CheckArithmetic(RandomWord(), RandomWord());
+
+    printf("Arithmetic test: %u pairs of operands, %u mismatches\n",
+           numEdges * numEdges + n, bad);
+    ASSERT(bad == 0);
 }
@@ -1,4 +1,5 @@
 #include "synch_console.hh"
+#include "threads/system.hh"
 #include <stdio.h>
 
 static void
@@ -38,6 +39,7 @@ SynchConsole::PutChar(char ch)
 {
     write->Acquire(); 
     console->PutChar(ch);
+    scheduler->BoostForIo(currentThread);
     writeDone->P();
     write->Release();
 }
@@ -46,6 +48,7 @@ char
 SynchConsole::GetChar()
 {
     read->Acquire(); 
+    scheduler->BoostForIo(currentThread);
     readAvail->P();
     char ch = console->GetChar();
     read->Release();
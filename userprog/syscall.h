@@ -25,6 +25,7 @@
 #define SC_JOIN     3
 #define SC_FORK     4
 #define SC_YIELD    5
+#define SC_TICKETS  6
 #define SC_CREATE  10
 #define SC_REMOVE  11
 #define SC_OPEN    12
@@ -77,6 +78,12 @@ int Fork(void (*func)(void));
 /// or not.
 void Yield();
 
+/// Hold `tickets` tickets, from 1 to 65536, to share the CPU with other
+/// threads in proportion to them, when the kernel runs stride scheduling.
+///
+/// Return 0 on success, or -1 if the count is out of range.
+int SetTickets(int tickets);
+
 
 /// File system operations: `Create`, `Open`, `Read`, `Write`, `Close`.
 ///
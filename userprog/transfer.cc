@@ -7,6 +7,8 @@
 #include "lib/utility.hh"
 #include "threads/system.hh"
 
+#include <string.h>
+
 
 void ReadBufferFromUser(int userAddress, char *outBuffer,
                         unsigned byteCount)
@@ -15,21 +17,9 @@ void ReadBufferFromUser(int userAddress, char *outBuffer,
     ASSERT(outBuffer != nullptr);
     ASSERT(byteCount != 0);
 
-    unsigned count = 0;
-    do {
-        int temp;
-        count++;
-
-        //ASSERT(machine->ReadMem(userAddress++, 1, &temp));
-        int j=0;
-        for(;j<5;j++){
-            if(machine->ReadMem(userAddress, 1, &temp)) break;
-        }
-        ASSERT(j<5);//terminaron las iteraciones y no ejecuto bien la funcion
-        userAddress++;
-
-        *outBuffer = (unsigned char) temp;
-    } while (count < byteCount);
+    // Copied a page at a time; page faults are handled along the way.
+    bool copied = machine->ReadBlock(userAddress, outBuffer, byteCount);
+    ASSERT(copied);
 }
 
 bool ReadStringFromUser(int userAddress, char *outString, // desde memoria virtual del usuario a la maquina
@@ -39,23 +29,12 @@ bool ReadStringFromUser(int userAddress, char *outString, // desde memoria virtu
     ASSERT(outString != nullptr);
     ASSERT(maxByteCount != 0);
 
-    unsigned count = 0;
-    do {
-        int temp;
-        count++;
-
-        //ASSERT(machine->ReadMem(userAddress++, 1, &temp));
-        int i=0;
-        for(;i<5;i++){
-            if(machine->ReadMem(userAddress, 1, &temp)) break;
-        }
-        ASSERT(i<5);//terminaron las iteraciones y no ejecuto bien la funcion
-        userAddress++;
+    unsigned length;
+    bool copied = machine->ReadString(userAddress, outString, maxByteCount,
+                                      &length);
+    ASSERT(copied);
 
-        *outString = (unsigned char) temp;
-    } while (*outString++ != '\0' && count < maxByteCount);
-
-    return *(outString - 1) == '\0';
+    return outString[length - 1] == '\0';
 }
 
 void WriteBufferToUser(const char *buffer, int userAddress, // desde la maquina a memoria virtual de usuario
@@ -65,21 +44,8 @@ void WriteBufferToUser(const char *buffer, int userAddress, // desde la maquina
     ASSERT(buffer != nullptr);
     ASSERT(byteCount != 0);
 
-    unsigned count = 0;
-    do {
-        int temp;
-        temp = (int)*buffer++;//(unsigned char) *outBuffer;
-        count++;
-
-        //ASSERT(machine->WriteMem(userAddress++, 1, temp));
-        int i=0;
-        for(;i<5;i++){
-            if(machine->WriteMem(userAddress, 1, temp)) break;
-        }
-        ASSERT(i<5);//terminaron las iteraciones y no ejecuto bien la funcion
-        userAddress++;
-
-    } while (count < byteCount);
+    bool copied = machine->WriteBlock(userAddress, buffer, byteCount);
+    ASSERT(copied);
 }
 
 void WriteStringToUser(const char *string, int userAddress)
@@ -87,18 +53,7 @@ void WriteStringToUser(const char *string, int userAddress)
     //ASSERT(userAddress != 0);//???
     ASSERT(string != nullptr);
 
-    unsigned count = 0;
-    do {
-        int temp;
-        temp = (int)*string;//(unsigned char) *outBuffer;
-        count++;
-
-        //ASSERT(machine->WriteMem(userAddress++, 1, temp));
-        int j=0;
-        for(;j<5;j++){
-            if(machine->WriteMem(userAddress, 1, temp)) break;
-        }
-        ASSERT(j<5);//terminaron las iteraciones y no ejecuto bien la funcion
-        userAddress++;
-    } while (*string++ != '\0');
+    bool copied = machine->WriteBlock(userAddress, string,
+                                      strlen(string) + 1);
+    ASSERT(copied);
 }